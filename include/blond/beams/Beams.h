@@ -13,16 +13,14 @@ namespace blond {
 #include <blond/globals.h>
 #include <blond/configuration.h>
 #include <blond/utilities.h>
+#include <blond/beams/ParticleStorage.h>
 #include <blond/input_parameters/GeneralParameters.h>
 #include <blond/input_parameters/RfParameters.h>
 
 namespace blond {
-    class Beams {
+    // dt, dE and id come from ParticleStorage
+    class Beams : public ParticleStorage {
     public:
-        f_vector_t dt;
-        f_vector_t dE;
-        // #NOTE id is 1 for active, 0 for inactive particles
-        int_vector_t id;
         double mass;
         double charge;
         double beta;
@@ -38,6 +36,16 @@ namespace blond {
         int n_macroparticles_lost;
         int n_macroparticles;
         long long intensity;
+        // When set, the slicing passes over this beam (the ngp histogram of
+        // Slices and the fused kick, drift and histogram of the tracker)
+        // also compute the statistics, at no extra pass over the particles.
+        // Subscribers, see BunchMonitor, then read the values of the last
+        // slicing instead of calling statistics().
+        bool stream_statistics;
+        // Set when a slicing pass has published the statistics, cleared by
+        // the subscriber that reads them. The deposits other than ngp do
+        // not stream, their subscribers fall back to statistics().
+        bool statistics_streamed;
         Beams(GeneralParameters *GP,
               const int _n_macroparticles,
               const long long _intensity);
@@ -53,10 +61,14 @@ namespace blond {
         //                        const double dE_max, int* __restrict id);
 
         void statistics();
+        // Sets mean, sigma, emittance and losses from moments in absolute
+        // dt
+        void set_statistics(const bunch_moments_t &moments);
 
     private:
-        void statistics(const double *__restrict dE,
-                        const double *__restrict dt,
+        template <typename T>
+        void statistics(const T *__restrict dE,
+                        const T *__restrict dt,
                         const int *__restrict id,
                         const int size);
     };
@@ -0,0 +1,249 @@
+/*
+ * ParticleStorage.h
+ */
+
+#ifndef BEAMS_PARTICLESTORAGE_H_
+#define BEAMS_PARTICLESTORAGE_H_
+
+#include <blond/configuration.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace blond {
+
+    // Alignment and padding of the particle arrays in bytes: one cache line,
+    // one AVX-512 register
+    const int PARTICLE_ALIGNMENT = 64;
+
+    // Number of elements of n, rounded up to a whole number of SIMD vectors
+    template <typename T>
+    static inline int simd_padded_size(const int n)
+    {
+        const int width = PARTICLE_ALIGNMENT / sizeof(T);
+        return (n + width - 1) / width * width;
+    }
+
+    // Allocates PARTICLE_ALIGNMENT aligned blocks, rounded up to a whole
+    // number of SIMD vectors. The padding past the requested size is zeroed,
+    // so a kernel may run its last vector over it without reading garbage.
+    template <typename T>
+    class aligned_allocator {
+    public:
+        typedef T value_type;
+
+        aligned_allocator() {}
+        template <typename U>
+        aligned_allocator(const aligned_allocator<U> &) {}
+
+        T *allocate(const std::size_t n)
+        {
+            const std::size_t bytes = (n * sizeof(T) + PARTICLE_ALIGNMENT - 1)
+                                      / PARTICLE_ALIGNMENT * PARTICLE_ALIGNMENT;
+            void *p = nullptr;
+            if (posix_memalign(&p, PARTICLE_ALIGNMENT, bytes ? bytes : 1) != 0)
+                throw std::bad_alloc();
+            std::memset(static_cast<char *>(p) + n * sizeof(T), 0,
+                        bytes - n * sizeof(T));
+            return static_cast<T *>(p);
+        }
+
+        void deallocate(T *p, const std::size_t) { std::free(p); }
+
+        template <typename U>
+        struct rebind { typedef aligned_allocator<U> other; };
+    };
+
+    template <typename T, typename U>
+    inline bool operator==(const aligned_allocator<T> &,
+                           const aligned_allocator<U> &) { return true; }
+
+    template <typename T, typename U>
+    inline bool operator!=(const aligned_allocator<T> &,
+                           const aligned_allocator<U> &) { return false; }
+
+    template <typename T>
+    using aligned_vector_t = std::vector<T, aligned_allocator<T>>;
+
+
+    // Non owning view of a particle array, what the kernels are given.
+    // Any std::vector converts to it, so callers can pass either the
+    // storage of a Beams object or a plain f_vector_t.
+    template <typename T>
+    class span_t {
+    public:
+        typedef typename std::remove_const<T>::type value_type;
+
+        span_t(T *data, const int size) : fData(data), fSize(size) {}
+
+        template <typename A>
+        span_t(std::vector<value_type, A> &v) : fData(v.data()), fSize(v.size()) {}
+
+        template <typename A>
+        span_t(const std::vector<value_type, A> &v)
+            : fData(v.data()), fSize(v.size()) {}
+
+        // span_t<T> -> span_t<const T>
+        template <typename U, typename = typename std::enable_if <
+                      std::is_same<const U, T>::value &&
+                      !std::is_same<U, T>::value >::type >
+        span_t(const span_t<U> &other) : fData(other.data()), fSize(other.size()) {}
+
+        T *data() const { return fData; }
+        int size() const { return fSize; }
+        T &operator[](const int i) const { return fData[i]; }
+        T *begin() const { return fData; }
+        T *end() const { return fData + fSize; }
+
+        // Only valid over storage that comes from aligned_allocator
+        int padded_size() const { return simd_padded_size<value_type>(fSize); }
+
+    private:
+        T *fData;
+        int fSize;
+    };
+
+
+    // Particles per block of the streamed statistics, small enough for the
+    // block to stay in cache between its two passes
+    const int STATISTICS_BLOCK_SIZE = 4096;
+
+    // Count, means and sums of squared deviations from the means of the
+    // alive particles. A block is reduced in two passes while it is in
+    // cache and the blocks are merged with the pairwise update of Chan et
+    // al., so the beam is read once without the cancellation of the sum of
+    // squares formula.
+    struct bunch_moments_t {
+        double n;
+        double mean_dt, mean_dE;
+        double m2_dt, m2_dE;
+
+        bunch_moments_t() : n(0), mean_dt(0), mean_dE(0), m2_dt(0), m2_dE(0) {}
+
+        template <typename T>
+        void add_block(const T *__restrict dt, const T *__restrict dE,
+                       const int *__restrict id, const int start,
+                       const int end)
+        {
+            bunch_moments_t block;
+            double s_dt = 0, s_dE = 0;
+            for (int i = start; i < end; ++i) {
+                block.n += id[i];
+                s_dt += id[i] * dt[i];
+                s_dE += id[i] * dE[i];
+            }
+            if (block.n == 0) return;
+            block.mean_dt = s_dt / block.n;
+            block.mean_dE = s_dE / block.n;
+            double q_dt = 0, q_dE = 0;
+            for (int i = start; i < end; ++i) {
+                q_dt += id[i] * (dt[i] - block.mean_dt) * (dt[i] - block.mean_dt);
+                q_dE += id[i] * (dE[i] - block.mean_dE) * (dE[i] - block.mean_dE);
+            }
+            block.m2_dt = q_dt;
+            block.m2_dE = q_dE;
+            merge(block);
+        }
+
+        void merge(const bunch_moments_t &other)
+        {
+            if (other.n == 0) return;
+            if (n == 0) {
+                *this = other;
+                return;
+            }
+            const double total = n + other.n;
+            const double d_dt = other.mean_dt - mean_dt;
+            const double d_dE = other.mean_dE - mean_dE;
+            mean_dt += d_dt * other.n / total;
+            mean_dE += d_dE * other.n / total;
+            m2_dt += other.m2_dt + d_dt * d_dt * n * other.n / total;
+            m2_dE += other.m2_dE + d_dE * d_dE * n * other.n / total;
+            n = total;
+        }
+    };
+
+
+    // Structure of arrays storage of the macro-particles. In double precision
+    // mode the coordinates live in dt/dE, in single precision mode in
+    // dt_f/dE_f and the double arrays are released, halving the memory
+    // traffic of kick, drift and slicing.
+    // In single precision dt_f holds dt - dt_reference, usually the
+    // synchronous particle, so that the float mantissa resolves the spread
+    // of the bunch instead of its position in the bucket. dE is already
+    // relative to the synchronous energy.
+    class ParticleStorage {
+    public:
+        enum precision_t { double_precision, single_precision };
+
+        precision_t precision;
+        double dt_reference;
+        aligned_vector_t<double> dt;
+        aligned_vector_t<double> dE;
+        aligned_vector_t<float> dt_f;
+        aligned_vector_t<float> dE_f;
+        // #NOTE id is 1 for active, 0 for inactive particles
+        aligned_vector_t<int> id;
+
+        ParticleStorage(const int n_particles = 0);
+        ~ParticleStorage();
+
+        int size() const { return id.size(); }
+        void resize(const int n_particles);
+
+        // Converts the coordinates to the given precision, dt_reference is
+        // only used for single precision
+        void set_precision(const precision_t new_precision,
+                           const double dt_reference = 0.);
+        // Exits with an error naming the caller if the coordinates are not
+        // stored in double precision
+        void require_double_precision(const std::string &caller) const;
+
+        // Sorts the particles by dt, in double precision, dE and id follow.
+        // A sorted beam costs one scan. Otherwise a stable LSD radix sort
+        // orders dt quantised to its 32 leading varying bits and the runs
+        // of equal keys are finished in place, so the cost stays O(N) for
+        // a bunch with a far away lost particle as for a compact one.
+        // Equal dt keep the order of the previous call. Every consumer of
+        // a dt ordered beam shares it.
+        void sort_by_dt();
+
+        template <typename T> span_t<T> dt_span();
+        template <typename T> span_t<T> dE_span();
+        span_t<int> id_span() { return span_t<int>(id); }
+
+    private:
+        // Particle moved by sort_by_dt(), with its quantised dt
+        struct sort_record_t {
+            uint32_t key;
+            int id;
+            double dt;
+            double dE;
+        };
+        // Scratch of sort_by_dt(), the passes go back and forth between
+        // the two
+        std::vector<sort_record_t> fSortRecords;
+        std::vector<sort_record_t> fSortRecordsTmp;
+        // Per thread and digit offsets of a pass
+        int_vector_t fSortOffsets;
+    };
+
+    template <>
+    inline span_t<double> ParticleStorage::dt_span<double>() { return dt; }
+
+    template <>
+    inline span_t<double> ParticleStorage::dE_span<double>() { return dE; }
+
+    template <>
+    inline span_t<float> ParticleStorage::dt_span<float>() { return dt_f; }
+
+    template <>
+    inline span_t<float> ParticleStorage::dE_span<float>() { return dE_f; }
+
+} // blond
+
+#endif /* BEAMS_PARTICLESTORAGE_H_ */
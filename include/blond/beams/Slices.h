@@ -14,26 +14,156 @@ namespace  blond {
 
 #include <blond/configuration.h>
 #include <blond/utilities.h>
+#include <blond/fft.h>
+#include <blond/beams/ParticleStorage.h>
 #include <blond/input_parameters/RfParameters.h>
+#include <fftw3.h>
 #include <map>
 
 namespace blond {
 
+    // Bins past each edge of the frame in the rows of Slices::thread_hist,
+    // where the stencils of the spline deposits may spill over
+    const int SPLINE_PADDING = 2;
+
+    // Sums the first rows of Slices::thread_counts into output. A row holds
+    // n_slices + 1 counters: the spare one takes the particles on the right
+    // edge, so the deposit needs no clamp, and goes to the last bin as in
+    // numpy.
+    inline void reduce_counts(const int *__restrict counts,
+                              double *__restrict output,
+                              const int n_slices, const int rows)
+    {
+        const int stride = n_slices + 1;
+        #pragma omp parallel for if (rows > 1)
+        for (int i = 0; i < n_slices; i++) {
+            int count = 0;
+            for (int t = 0; t < rows; t++)
+                count += counts[t * stride + i];
+            output[i] = count;
+        }
+        for (int t = 0; t < rows; t++)
+            output[n_slices - 1] += counts[t * stride + n_slices];
+    }
+
+    // B-spline particle shape of the given order on the bin centers: u is
+    // the position in bins from the first bin center. Returns the first of
+    // the ORDER + 1 bins the particle is spread over and fills their weights.
+    template <int ORDER>
+    static inline int spline_weights(const double u, double w[ORDER + 1]);
+
+    // Linear, two bins
+    template <>
+    inline int spline_weights<1>(const double u, double w[2])
+    {
+        const int j = (int) std::floor(u);
+        const double f = u - j;
+        w[0] = 1. - f;
+        w[1] = f;
+        return j;
+    }
+
+    // Quadratic, triangular-shaped cloud, three bins around the nearest
+    template <>
+    inline int spline_weights<2>(const double u, double w[3])
+    {
+        const int j = (int) std::floor(u + 0.5);
+        const double d = u - j;
+        w[0] = 0.5 * (0.5 - d) * (0.5 - d);
+        w[1] = 0.75 - d * d;
+        w[2] = 0.5 * (0.5 + d) * (0.5 + d);
+        return j - 1;
+    }
+
+    // Cubic, four bins
+    template <>
+    inline int spline_weights<3>(const double u, double w[4])
+    {
+        const int j = (int) std::floor(u);
+        const double f = u - j;
+        const double g = 1. - f;
+        w[0] = g * g * g / 6.;
+        w[1] = (4. - 6. * f * f + 3. * f * f * f) / 6.;
+        w[2] = (4. - 6. * g * g + 3. * g * g * g) / 6.;
+        w[3] = f * f * f / 6.;
+        return j - 1;
+    }
+
+    // Below this many particles the ngp histogram is deposited by one
+    // thread, without any reduction
+    const int HISTOGRAM_SERIAL_SIZE = 16384;
+
+    // Number of private histograms, and of threads, of an ngp deposit of
+    // n particles into n_slices bins with up to threads threads. The
+    // deposit costs about one count per particle and the reduction one
+    // per bin and copy, so with c copies the pass takes n / c + n_slices *
+    // c / threads, least at c = sqrt(n * threads / n_slices). Many
+    // particles per bin give every thread its copy, fine profiles of few
+    // particles fewer copies and a cheaper reduction.
+    int histogram_copies(const int n, const int n_slices, const int threads);
+
+    // The adaptive frame shrinks when the bunch fills less than this
+    // fraction of it, some hysteresis so that it does not flip between two
+    // sizes
+    const double FRAME_SHRINK = 0.7;
+
     class Slices {
     private:
         const double cfwhm = 2 * std::sqrt(2 * std::log(2));
-        double *thread_hist;
 
-        f_vector_t gaussian_filter1d(f_vector_t &x, int sigma,
-                                     int order, std::string mode);
-        f_vector_t gradient(f_vector_t &x, double dist);
+        // Chebyshev filter of a filter_option at a bin width, designed
+        // once, see beam_profile_filter_chebyshev()
+        struct chebyshev_filter_t {
+            int order;
+            f_vector_t b, a, zi;
+        };
+        typedef std::pair<std::map<std::string, std::string>, double>
+        filter_key_t;
+        std::map<filter_key_t, chebyshev_filter_t> fChebyshevFilters;
+        // Odd extension of the profile filtered by filtfilt
+        f_vector_t fFilterWork;
+        const chebyshev_filter_t &chebyshev_filter(
+            const std::map<std::string, std::string> &filter_option);
+
+        // Bunch of every RF bucket of the turn, -1 for the empty ones
+        int_vector_t fBucketBunch;
+        // Per thread counters of bunch_profiles
+        int_vector_t fBunchThreadCounts;
+
+        // Real to complex plan of beam_spectrum_generation(), from
+        // fSpectrumInput straight into fBeamSpectrum, its size and the
+        // leading bins of the input written by the last call. A copy of
+        // the slices plans again on its own input.
+        fft::owned_plan_t fSpectrumPlan;
+        int fSpectrumN;
+        int fSpectrumFilled;
+        aligned_vector_t<double> fSpectrumInput;
+        // Bin width fBeamSpectrumFreq was computed for
+        double fSpectrumDt;
     public:
         enum cuts_unit_t { s, rad };
+        enum derivative_t { filter1d, gradient, diff };
         enum fit_t { normal, gaussian };
+        // Particle shape of the slicing in track(): nearest bin
+        // (histogram), linear (smooth_histogram), or the quadratic and
+        // cubic B-splines (spline_histogram), which spread every particle
+        // over 3 and 4 bins and give smoother profiles for as many
+        // particles
+        enum deposit_t { ngp, linear, tsc, cubic };
 
         Beams *beam;
         RfParameters *rfp;
 
+        // (n_slices + 2 * SPLINE_PADDING) * max_threads private histograms,
+        // one row per thread, for the weighted deposits
+        f_vector_t thread_hist;
+        // (n_slices + 1) * max_threads private counters of the ngp
+        // deposits, see reduce_counts()
+        int_vector_t thread_counts;
+        // Per thread moments of the statistics streamed with the histogram,
+        // see Beams::stream_statistics
+        std::vector<bunch_moments_t> thread_moments;
+
         double bl_fwhm, bp_fwhm;
         double bp_rms, bl_rms;
         int n_slices;
@@ -45,31 +175,84 @@ namespace blond {
         f_vector_t edges;
         f_vector_t bin_centers;
         fit_t fit_option;
+        deposit_t deposit;
         complex_vector_t fBeamSpectrum;
         f_vector_t fBeamSpectrumFreq;
         double bl_gauss;
         double bp_gauss;
 
+        // Multi-bunch slicing, see set_bunch_pattern(): the occupied RF
+        // buckets (0...h-1, counted from phi_rf / omega_rf of the turn) and
+        // one frame of n_slices_bunch bins over the bucket of every bunch
+        int_vector_t bunch_pattern;
+        int n_slices_bunch;
+        // n_bunches x n_slices_bunch, one row per bunch
+        f_vector_t bunch_profiles;
+        // Left edge of the frame of every bunch and the common bin width
+        f_vector_t bunch_cut_left;
+        double bunch_bin_width;
+        // Bunch by bunch FWHM and rms bunch length (4 sigma) and position
+        f_vector_t bl_fwhm_bbb, bp_fwhm_bbb;
+        f_vector_t bl_rms_bbb, bp_rms_bbb;
+
+        // Adaptive frame, see set_adaptive_frame()
+        bool adaptive_frame;
+        double frame_n_sigma;
+        double frame_bin_width;
+        int frame_min_slices;
+        int frame_max_slices;
+        // Set when a slicing pass has published the beam statistics,
+        // cleared by track_frame(), which otherwise computes them
+        bool frame_statistics_streamed;
+
         Slices(RfParameters *RfP, Beams *Beam,
                int _n_slices, int _n_sigma = 0, double cut_left = 0,
                double cut_right = 0, cuts_unit_t cuts_unit = s,
-               fit_t fit_option = normal, bool direct_slicing = false);
+               fit_t fit_option = normal, bool direct_slicing = false,
+               deposit_t deposit = ngp);
 
         ~Slices();
         void track();
         // double fast_fwhm();
         void fwhm(const double shift = 0);
+        // Spectrum of the n point, zero padded profile, numpy.fft.rfft. The
+        // plan and fBeamSpectrumFreq are kept while n and the bin width
+        // are unchanged, the profile is copied once into the aligned input
+        // and the plan writes fBeamSpectrum in place. With onlyRFFT only
+        // the frequencies are updated.
         void beam_spectrum_generation(int n, bool onlyRFFT = false);
+        // Derivative of the profile on the bin centers, into the n_slices
+        // values of derivative: convolution with the derivative of a
+        // gaussian of one bin (filter1d, periodic profile), or central
+        // differences with one sided ones at the edges (gradient, diff).
+        // Allocation free, cheap enough to run every turn.
+        void beam_profile_derivative(double *__restrict derivative,
+                                     const derivative_t mode) const;
+        // Same with mode "filter1d", "gradient" or "diff", x is set to the
+        // bin centers
         void beam_profile_derivative(f_vector_t &x,
                                      f_vector_t &derivative,
                                      std::string mode = "gradient");
 
+        // Filters the profile in place with the zero phase Chebyshev type
+        // II low-pass filter of filter_option: pass_frequency and
+        // stop_frequency in Hz, gain_pass and gain_stop in dB. The filter
+        // is designed on the first call for a filter_option and bin width.
+        // Returns the order of the filter.
+        int beam_profile_filter_chebyshev(const std::map<std::string,
+                                          std::string> &filter_option);
+
+        // The order and coefficients of the filter, without filtering.
+        // filter_option must not have transfer_function_plot = "true".
         void beam_profile_filter_chebyshev(std::map<std::string, std::string>
                                            filter_option,
                                            int &nCoefficients,
                                            f_vector_t &b,
                                            f_vector_t &a);
 
+        // The order and the response of the filter at n_slices frequencies
+        // from 0 to the Nyquist frequency, without filtering. filter_option
+        // must have transfer_function_plot = "true".
         void beam_profile_filter_chebyshev(std::map<std::string, std::string>
                                            filter_option,
                                            int &nCoefficients,
@@ -79,21 +262,80 @@ namespace blond {
         void sort_particles();
         double convert_coordinates(double cut, cuts_unit_t type);
 
-        void histogram(const double *__restrict input, double *__restrict output,
+        // Instantiated for double and float coordinates. Counts in int
+        // rows of thread_counts, as many as histogram_copies() picks.
+        template <typename real_t>
+        void histogram(const real_t *__restrict input, double *__restrict output,
                        const double cut_left, const double cut_right,
                        const int n_slices, const int n_macroparticles);
 
-        void smooth_histogram(const double *__restrict input,
+        // histogram() that also accumulates the moments of the alive
+        // particles in thread_moments, one block of particles at a time
+        template <typename real_t>
+        void histogram_statistics(const real_t *__restrict dt,
+                                  const real_t *__restrict dE,
+                                  const int *__restrict id,
+                                  double *__restrict output,
+                                  const double cut_left,
+                                  const double cut_right, const int n_slices,
+                                  const int n_macroparticles);
+        // Merges thread_moments in thread order into the statistics of the
+        // beam and clears them. dt_offset is added to the mean dt of the
+        // single precision coordinates.
+        void publish_statistics(const double dt_offset = 0.);
+
+        template <typename real_t>
+        void smooth_histogram(const real_t *__restrict input,
+                              double *__restrict output, const double cut_left,
+                              const double cut_right, const int n_slices,
+                              const int n_macroparticles);
+
+        // ORDER 2 or 3 B-spline deposit, the weights that fall outside the
+        // frame are dropped
+        template <int ORDER, typename real_t>
+        void spline_histogram(const real_t *__restrict input,
                               double *__restrict output, const double cut_left,
                               const double cut_right, const int n_slices,
                               const int n_macroparticles);
         void slice_constant_space_histogram();
         void track_cuts();
+        // Makes track() follow the bunch with a frame of n_sigma rms bunch
+        // lengths (sigma_dt of the last beam statistics) at the current bin
+        // width. The number of slices moves in steps of regular numbers,
+        // see mymath::next_regular(), within [min_slices, max_slices], so
+        // that the induced voltages can cache their tables for every size
+        // and a change of frame costs O(n_slices).
+        void set_adaptive_frame(const double n_sigma, const int min_slices,
+                                const int max_slices);
+        // Recentres the frame on the bunch, and resizes it when the bunch
+        // has outgrown it or fills less than FRAME_SHRINK of it. Returns
+        // true if n_slices changed. Uses the statistics streamed by the
+        // last slicing pass, else calls beam->statistics(); a bunch without
+        // length leaves the frame as it is.
+        bool track_frame();
+        // Frame of n slices of frame_bin_width centred on center
+        void resize_frame(const int n, const double center);
         void slice_constant_space_histogram_smooth();
+        void slice_constant_space_histogram_tsc();
+        void slice_constant_space_histogram_cubic();
         void rms();
         void gaussian_fit();
 
-        void fwhm_multibunch();
+        // Switches on multi-bunch slicing, track() then also builds the
+        // profile of every bunch. An empty pattern switches it off.
+        void set_bunch_pattern(const int_vector_t &buckets,
+                               const int n_slices_bunch);
+        int n_bunches() const { return bunch_pattern.size(); }
+        // Profiles of all the bunches in one pass over the beam, every
+        // particle is tagged by its RF bucket
+        void slice_multibunch();
+        template <typename real_t>
+        void bunch_histogram(const real_t *__restrict input,
+                             const double bucket_start,
+                             const double bucket_length,
+                             const int n_macroparticles);
+        void fwhm_multibunch(const double shift = 0);
+        void rms_multibunch();
         // when intensity effects
     };
 }
@@ -147,10 +147,64 @@ namespace blond {
             return fftw_plan_dft_c2r_1d(n, b, out, flag);
         }
 
+        // howmany inverse real transforms of size n in one plan, from rows of
+        // n / 2 + 1 points of in to rows of n points of out
+        static inline fftw_plan init_irfft_many(const int n, const int howmany,
+                                                complex_t *in, double *out,
+                                                const unsigned flag = FFTW_ESTIMATE,
+                                                const int threads = 1)
+        {
+#ifdef USE_FFTW_OMP
+            if (threads > 1) {
+                fftw_init_threads();
+                fftw_plan_with_nthreads(threads);
+            }
+#endif
+            fftw_complex *b;
+            b = reinterpret_cast<fftw_complex *>(in);
+            return fftw_plan_many_dft_c2r(1, &n, howmany, b, NULL, 1, n / 2 + 1,
+                                          out, NULL, 1, n, flag);
+        }
+
         static inline void run_fft(const fftw_plan &p) { fftw_execute(p); }
 
         static inline void destroy_fft(fftw_plan &p) { fftw_destroy_plan(p); }
 
+        // Plan on the buffers of the object that holds it, destroyed with
+        // it. A copy or an assignment starts without a plan, as the plan of
+        // the original transforms the buffers of the original, so its owner
+        // plans again on its own buffers before the next transform.
+        class owned_plan_t {
+        public:
+            owned_plan_t() : fPlan(NULL) {}
+            owned_plan_t(const owned_plan_t &) : fPlan(NULL) {}
+            ~owned_plan_t() { reset(); }
+
+            owned_plan_t &operator=(const owned_plan_t &)
+            {
+                reset();
+                return *this;
+            }
+
+            owned_plan_t &operator=(const fftw_plan p)
+            {
+                reset();
+                fPlan = p;
+                return *this;
+            }
+
+            operator fftw_plan() const { return fPlan; }
+
+            void reset()
+            {
+                if (fPlan) fftw_destroy_plan(fPlan);
+                fPlan = NULL;
+            }
+
+        private:
+            fftw_plan fPlan;
+        };
+
         static inline void destroy_plans()
         {
             // std::cout<<"planV size = " << planV.size()<<"\n";
@@ -10,7 +10,10 @@
 
 #include <blond/configuration.h>
 #include <blond/beams/Beams.h>
+#include <blond/fft.h>
 #include <blond/impedances/Intensity.h>
+#include <fftw3.h>
+#include <map>
 #include <vector>
 
 namespace blond {
@@ -21,6 +24,33 @@ namespace blond {
                             const int n_slices,
                             const int n_macroparticles);
 
+    // beam_dt holds dt - dt_offset, see ParticleStorage::dt_reference
+    void linear_interp_kick(const float *__restrict beam_dt,
+                            float *__restrict beam_dE,
+                            const double *__restrict voltage_array,
+                            const double *__restrict bin_centers,
+                            const int n_slices,
+                            const int n_macroparticles,
+                            const double dt_offset = 0.);
+
+    // Kicks the particles of beam, in whichever precision they are stored,
+    // with scale times the interpolated voltage
+    void linear_interp_kick(Beams *beam,
+                            const double *__restrict voltage_array,
+                            const double *__restrict bin_centers,
+                            const int n_slices,
+                            const double scale = 1.);
+
+    // Kicks the particles of beam with the voltage on the bin centers of
+    // slices, interpolated with the particle shape of its deposit, so that
+    // slicing and kick are symmetric. Linear for ngp and linear deposits.
+    // scale multiplies the kick, the charge of the beam for an induced
+    // voltage, so the voltage is not copied to scale it.
+    void deposit_interp_kick(Beams *beam,
+                             const double *__restrict voltage_array,
+                             const Slices *slices,
+                             const double scale = 1.);
+
 
     class InducedVoltage {
     public:
@@ -36,9 +66,16 @@ namespace blond {
         virtual ~InducedVoltage() {};
     };
 
+    // Multiply-adds one point of n log2(n) of a real FFT size n costs, for
+    // the forward and inverse transform and the product together. Sets
+    // where InducedVoltageTime switches from the direct to the FFT
+    // convolution, at a frame of about 128 slices.
+    const double CONVOLUTION_FFT_COST = 4.0;
+
     class InducedVoltageTime : public InducedVoltage {
     public:
-        enum time_or_freq { time_domain, freq_domain };
+        // automatic picks the cheaper of the two for the current frame
+        enum time_or_freq { time_domain, freq_domain, automatic };
 
         std::vector<Intensity *> fWakeSourceList;
         f_vector_t fTimeArray;
@@ -46,16 +83,50 @@ namespace blond {
         int fCut;
         int fShape;
         time_or_freq fTimeOrFreq;
+        // Number of slices of fTotalWake. The adaptive frame of Slices
+        // keeps the bin width, so the wake of every number of slices is
+        // computed once and cached.
+        int fFrameSlices;
+        std::map<int, f_vector_t> fWakeCache;
 
         void track(Beams *beam);
         void sum_wakes(f_vector_t &v);
         void reprocess(Slices *newSlices);
+        // Switches to the wake of the current number of slices
+        void update_frame();
+        // Convolves only the points of the profile that are kept, directly
+        // or with the wake spectrum of the frame, and writes
+        // fInducedVoltage without allocating once the sizes are set. The
+        // returned vector is only filled when length > 0.
         f_vector_t induced_voltage_generation(Beams *beam, int length = 0);
+        // Whether the FFT convolution is used for nOut points of the
+        // current frame
+        bool use_fft(const int nOut) const;
         InducedVoltageTime(Slices *slices,
                            const std::vector<Intensity *> &WakeSourceList,
-                           time_or_freq TimeOrFreq = freq_domain);
+                           time_or_freq TimeOrFreq = automatic);
 
         ~InducedVoltageTime();
+
+    private:
+        // Real to complex plan from fConvInput into fConvSpectrum, complex to
+        // real plan from fConvSpectrum into fConvOutput, of size fConvN.
+        // fWakeSpectrum is the spectrum of fTotalWake on fShape points, made
+        // once per frame by prepare_convolution(). A copy plans again on
+        // its own buffers.
+        fft::owned_plan_t fForwardPlan;
+        fft::owned_plan_t fBackwardPlan;
+        int fConvN;
+        aligned_vector_t<double> fConvInput;
+        aligned_vector_t<complex_t> fConvSpectrum;
+        aligned_vector_t<double> fConvOutput;
+        aligned_vector_t<complex_t> fWakeSpectrum;
+        // Voltage of the direct convolution
+        f_vector_t fConvVoltage;
+        // Sizes of the convolution of the frame, drops the wake spectrum
+        void prepare_convolution();
+        // Plans and wake spectrum of the frame, at its first FFT convolution
+        void plan_convolution();
     };
 
     class InducedVoltageFreq : public InducedVoltage {
@@ -87,6 +158,10 @@ namespace blond {
         freq_res_option_t fFreqResOption;
         // *Total impedance array of all sources in* [:math:`\Omega`]
         complex_vector_t fTotalImpedance;
+        // With saveIndividualVoltages, the impedance and the induced voltage
+        // of every source, one row per source in the order of
+        // fImpedanceSourceList: source i starts at i * fFreqArray.size() and
+        // at i * n_slices. fInducedVoltage is the sum of the rows.
         complex_vector_t fMatrixSaveIndividualImpedances;
         f_vector_t fMatrixSaveIndividualVoltages;
 
@@ -98,6 +173,18 @@ namespace blond {
         complex_vector_t fTotalImpedanceMem;
         f_vector_t fTimeArrayMem;
 
+        // Impedance tables of one number of slices at the bin width of the
+        // adaptive frame of Slices, see update_frame()
+        struct frame_tables_t {
+            int n_fft_sampling;
+            double freq_resolution;
+            f_vector_t freq_array;
+            complex_vector_t total_impedance;
+            complex_vector_t individual_impedances;
+        };
+        int fFrameSlices;
+        std::map<int, frame_tables_t> fFrameCache;
+
         // *Induced voltage from the sum of the wake sources in [V]*
         // f_vector_t fInducedVoltage;
 
@@ -106,6 +193,11 @@ namespace blond {
 
         // Reprocess the impedance contributions with respect to the new_slicing.
         void reprocess(Slices *newSlices);
+        // Switches to the tables of the current number of slices, from the
+        // cache if this size has been seen before, in O(n_slices)
+        void update_frame();
+        // Writes fInducedVoltage without allocating once the sizes are set.
+        // The returned vector is only filled when length > 0.
         f_vector_t induced_voltage_generation(Beams *beam, int length = 0);
         InducedVoltageFreq(Slices *slices,
                            const std::vector<Intensity *> &impedanceSourceList,
@@ -114,6 +206,26 @@ namespace blond {
                            int NTurnsMem = 0, bool recalculationImpedance = false,
                            bool saveIndividualVoltages = false);
         ~InducedVoltageFreq();
+
+    private:
+        // Sampling, frequencies and impedances of the current slices
+        void process_frame();
+        void save_individual_impedances();
+
+        // Complex to real plan of induced_voltage_generation(), of
+        // fVoltageRows transforms of size fVoltageN at once, from the rows of
+        // fVoltageSpectrum into the rows of fVoltageOutput. A copy plans
+        // again on its own rows.
+        fft::owned_plan_t fVoltagePlan;
+        int fVoltageN;
+        int fVoltageRows;
+        aligned_vector_t<complex_t> fVoltageSpectrum;
+        aligned_vector_t<double> fVoltageOutput;
+        // Inverse transforms of rows consecutive impedances, of the size of
+        // the beam spectrum, times the beam spectrum into the rows of
+        // fVoltageOutput. The plan is rebuilt only when the spectrum or the
+        // number of rows change.
+        void impedance_voltage(const complex_t *impedance, const int rows);
     };
 
     class TotalInducedVoltage : public InducedVoltage {
@@ -127,8 +239,27 @@ namespace blond {
 
         Beams *fBeam;
 
+        // Multi-turn wake memory, with NTurnsMemory > 0 and the
+        // InducedVoltageFreq sources built with as many turns of memory.
+        // fArrayMemory is the spectrum, on the fNPointsFFT points of the
+        // memory window, of the voltage the past turns leave from the
+        // start of the frame on, fSumImpedancesMemory the impedance of all
+        // the sources on the same frequencies.
+        int fLenArrayMem;
+        int fNPointsFFT;
+        f_vector_t fFreqArrayMem;
+        complex_vector_t fSumImpedancesMemory;
+        complex_vector_t fArrayMemory;
+
+        // Goes through track_memory() when NTurnsMemory > 0
         void track(Beams *beam);
-        void track_memory();
+        // Shifts the memory by the revolution time of the turn, adds the
+        // voltage of the current profile, keeps the first fLenArrayMem
+        // points for the next turn and kicks beam. O(fNPointsFFT) besides
+        // three planned FFTs, whatever the number of turns of memory. The
+        // frame must not change, so no adaptive frame.
+        void track_memory(Beams *beam);
+        // Kicks ghostBeam with the voltage of the turn, without slicing it
         void track_ghosts_particles(Beams *ghostBeam);
         f_vector_t induced_voltage_sum(Beams *beam, int length = 0);
         void reprocess(Slices *newSlices);
@@ -145,6 +276,21 @@ namespace blond {
                             f_vector_t RevTimeArray = f_vector_t());
 
         ~TotalInducedVoltage();
+
+    private:
+        // exp(2 pi j f T) of the memory frequencies for the revolution
+        // time fMemoryRevTime
+        double fMemoryRevTime;
+        complex_vector_t fMemoryPhase;
+        // Real to complex plan of fNPointsFFT points from fMemoryReal into
+        // fMemorySpectrum and its complex to real inverse, both run twice
+        // per turn on these buffers. Made at the first turn of memory, of
+        // a copy too.
+        fft::owned_plan_t fMemoryForward;
+        fft::owned_plan_t fMemoryBackward;
+        aligned_vector_t<double> fMemoryReal;
+        aligned_vector_t<complex_t> fMemorySpectrum;
+        void plan_memory();
     };
 } // blond
 #endif /* IMPEDANCES_INDUCEDVOLTAGE_H_ */
\ No newline at end of file
@@ -117,8 +117,8 @@ namespace blond {
 
             Qs.resize(n_turns + 1);
             for (int i = 0; i < n_turns + 1; ++i)
-                Qs[i] = std::sqrt(harmonic[section_index][i] * charge
-                                  * voltage[section_index][i]
+                Qs[i] = std::sqrt(harmonic[0][i] * charge
+                                  * voltage[0][i]
                                   * std::abs(eta_0[i] * std::cos(phi_s[i])) /
                                   (2 * constant::pi * beta[i] *
                                    beta[i] * energy[i]));
@@ -147,7 +147,7 @@ namespace blond {
             dphi_rf.resize(n_rf, 0);
             dphi_rf_steering.resize(n_rf, 0);
 
-            t_rf = (2. * constant::pi) / omega_rf[section_index];
+            t_rf = (2. * constant::pi) / omega_rf[0];
             // t_rf.resize(n_turns + 1);
             // for (int i = 0; i < n_turns + 1; ++i)
             //     t_rf[i] = 2 * constant::pi / omega_rf[section_index][i];
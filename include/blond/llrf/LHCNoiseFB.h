@@ -13,6 +13,8 @@
  *  Update the noise amplitude scaling using track().
  *  Pass the bunch pattern (occupied bucket numbers from 0...h-1) in buckets
  *  for multi-bunch simulations; the feedback uses the average bunch length.
+ *  If the slices are in multi-bunch mode over the same buckets, see
+ *  Slices::set_bunch_pattern(), their bunch by bunch FWHM is used.
  *
  */
 
@@ -38,6 +38,12 @@ namespace blond {
         PhaseNoise *RFnoise;
         LHCNoiseFB *noiseFB;
         virtual ~PhaseLoop() {};
+    protected:
+        // Scratch of beam_phase(): the window and its sine and cosine
+        // components, kept between turns
+        f_vector_t window;
+        f_vector_t window_sin;
+        f_vector_t window_cos;
     };
 
     class LHC : public PhaseLoop {
@@ -68,13 +68,75 @@ namespace blond {
 
         static inline double fast_exp(double x) { return vdt::fast_exp(x); }
 
-        // linear convolution function
+        // Array versions of the above, see src/math_functions.cpp
+        // An AVX-512 or AVX2 kernel is picked at runtime, with a scalar
+        // fallback. The output array may be the input array itself.
+        enum simd_isa_t { scalar_isa, avx2_isa, avx512_isa };
+
+        simd_isa_t simd_isa();
+        // Lower the kernel in use (never above what the cpu supports)
+        void set_simd_isa(simd_isa_t isa);
+
+        void fast_sin_v(const double *in, double *out, const int n);
+
+        void fast_cos_v(const double *in, double *out, const int n);
+
+        void fast_sincos_v(const double *in, double *sin_out,
+                           double *cos_out, const int n);
+
+        void fast_exp_v(const double *in, double *out, const int n);
+
+        // Least squares fit of p[0] * exp(-(x - p[1])^2 / (2 p[2]^2)) to
+        // the n points (x, y) with Levenberg-Marquardt, started from p and
+        // solved in place. Allocation free, for the per turn fit of the
+        // bunch profile. Returns false if it did not converge.
+        bool gaussian_fit(const double *__restrict x,
+                          const double *__restrict y, const int n,
+                          double p[3]);
+
+        // Chebyshev type II low-pass digital filters, ports of the
+        // scipy.signal functions of the same names. Frequencies are
+        // normalised to the Nyquist frequency.
+
+        // Lowest order meeting gpass dB of ripple up to wp and gstop dB of
+        // attenuation from ws on, wn is set to the stopband edge
+        int cheb2ord(const double wp, const double ws, const double gpass,
+                     const double gstop, double &wn);
+
+        // b and a, order + 1 coefficients each with a[0] = 1, of the filter
+        // with gstop dB of attenuation from wn on
+        void cheby2(const int order, const double gstop, const double wn,
+                    f_vector_t &b, f_vector_t &a);
+
+        // Steady state of lfilter for a unit step input, one value per
+        // coefficient but the first
+        void lfilter_zi(const f_vector_t &b, const f_vector_t &a,
+                        f_vector_t &zi);
+
+        // Zero phase filtering of the n points of x into y, forward and
+        // backward over the odd extension of x by 3 * b.size() points on
+        // each side, as filtfilt(b, a, x). zi is from lfilter_zi(), work is
+        // resized to the extended signal and may be kept between calls.
+        // y may be x.
+        void filtfilt(const f_vector_t &b, const f_vector_t &a,
+                      const f_vector_t &zi, const double *x, double *y,
+                      const int n, f_vector_t &work);
+
+        // Response at the n frequencies w = pi * k / n, k = 0...n-1, as
+        // freqz(b, a, worN=n)
+        void freqz(const f_vector_t &b, const f_vector_t &a, const int n,
+                   double *__restrict w, complex_t *__restrict h);
+
+        // linear convolution function, only the first ResLen points of the
+        // result if ResLen > 0
         static inline void convolution(const double *__restrict signal,
                                        const int SignalLen,
                                        const double *__restrict kernel,
-                                       const int KernelLen, double *__restrict res)
+                                       const int KernelLen, double *__restrict res,
+                                       const int ResLen = 0)
         {
-            const int size = KernelLen + SignalLen - 1;
+            const int full = KernelLen + SignalLen - 1;
+            const int size = (ResLen > 0 && ResLen < full) ? ResLen : full;
 
             #pragma omp parallel for
             for (auto n = 0; n < size; ++n) {
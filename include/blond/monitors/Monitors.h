@@ -87,6 +87,11 @@ namespace blond {
         PhaseLoop *fPL;
         LHCNoiseFB *fNoiseFB;
         bool fGaussian;
+        // Reads the statistics streamed by the slicing of the turn instead
+        // of computing them, see Beams::stream_statistics. The values are
+        // those of the slicing pass; a turn whose slicing did not stream
+        // them, such as a deposit other than ngp, computes them.
+        bool fStreamedStatistics;
         void track();
         void init_data(const int dimension);
         void init_buffer();
@@ -97,7 +102,8 @@ namespace blond {
         BunchMonitor(GeneralParameters *GP, RfParameters *RfP, Beams *Beam,
                      std::string filename, int buffer_time = 0,
                      Slices *Slices = NULL, PhaseLoop *PL = NULL,
-                     LHCNoiseFB *noiseFB = NULL, int compression_level = 9);
+                     LHCNoiseFB *noiseFB = NULL, int compression_level = 9,
+                     bool streamed_statistics = false);
         ~BunchMonitor();
     };
 } // blond
@@ -46,6 +46,12 @@ namespace blond {
         int_vector_t indices_right_outside;
         int_vector_t indices_inside_frame;
         int_vector_t indices_left_outside;
+        // Gathered coordinates of the periodicity option, kept between
+        // turns so that their capacity is reused
+        f_vector_t insiders_dt;
+        f_vector_t insiders_dE;
+        f_vector_t left_dt;
+        f_vector_t left_dE;
 
         f_vector_t acceleration_kick;
         f_vector_t fRfVoltage;
@@ -53,6 +59,12 @@ namespace blond {
         double dE_max;
         bool rf_kick_interp;
         bool periodicity;
+        // Deposit the slices histogram in the same pass as kick and drift,
+        // replaces the separate Slices::track() call for the ngp deposit
+        bool fused_slicing;
+        // Full solver drift with a refined single precision reciprocal
+        // instead of a division, relative error ~1e-14
+        bool fast_reciprocal;
 
         LHCNoiseFB *noiseFB;
         PhaseLoop *PL;
@@ -61,24 +73,122 @@ namespace blond {
         f_vector_t fTotalVoltage;
 
         void set_periodicity();
-        void kick(f_vector_t &beam_dt, f_vector_t &beam_dE, const int index);
-        inline void kick(const double *__restrict beam_dt, double *__restrict beam_dE,
+        // Kick and drift of any set of particles, e.g. the coordinates of a
+        // Beams object in either precision or plain f_vector_t
+        void kick(span_t<const double> beam_dt, span_t<double> beam_dE,
+                  const int index);
+        // beam_dt holds dt - dt_reference, see ParticleStorage
+        void kick(span_t<const float> beam_dt, span_t<float> beam_dE,
+                  const int index, const double dt_reference = 0.);
+        template <typename real_t>
+        inline void kick(const real_t *__restrict beam_dt,
+                         real_t *__restrict beam_dE,
                          const int n_rf, const double *__restrict voltage,
                          const double *__restrict omega_RF,
                          const double *__restrict phi_RF, const int n_macroparticles,
                          const double acc_kick);
-        void drift(f_vector_t &beam_dt, f_vector_t &beam_dE, const int index);
-        inline void drift(double *__restrict beam_dt,
-                          const double *__restrict beam_dE, const solver_type solver,
+        void drift(span_t<double> beam_dt, span_t<const double> beam_dE,
+                   const int index);
+        void drift(span_t<float> beam_dt, span_t<const float> beam_dE,
+                   const int index);
+        template <typename real_t>
+        inline void drift(real_t *__restrict beam_dt,
+                          const real_t *__restrict beam_dE, const solver_type solver,
                           const double T0, const double length_ratio,
                           const int alpha_order, const double eta_zero,
                           const double eta_one, const double eta_two,
                           const double beta, const double energy,
                           const int n_macroparticles);
 
+        // Kick at turn index followed by the drift to turn index + 1,
+        // one cache-sized block of particles at a time
+        void kick_drift(span_t<double> beam_dt, span_t<double> beam_dE,
+                        const int index);
+        void kick_drift(span_t<float> beam_dt, span_t<float> beam_dE,
+                        const int index, const double dt_reference = 0.);
+        template <typename real_t>
+        inline void kick_drift(real_t *__restrict beam_dt,
+                               real_t *__restrict beam_dE,
+                               const int n_rf,
+                               const double *__restrict voltage,
+                               const double *__restrict omega_RF,
+                               const double *__restrict phi_RF,
+                               const double acc_kick,
+                               const solver_type solver,
+                               const double T0,
+                               const double length_ratio,
+                               const int alpha_order,
+                               const double eta_zero,
+                               const double eta_one,
+                               const double eta_two,
+                               const double beta,
+                               const double energy,
+                               const int n_macroparticles);
+
+        template <typename real_t>
+        inline void kick_drift_histogram(real_t *__restrict beam_dt,
+                                         real_t *__restrict beam_dE,
+                                         const int n_rf,
+                                         const double *__restrict voltage,
+                                         const double *__restrict omega_RF,
+                                         const double *__restrict phi_RF,
+                                         const double acc_kick,
+                                         const solver_type solver,
+                                         const double T0,
+                                         const double length_ratio,
+                                         const int alpha_order,
+                                         const double eta_zero,
+                                         const double eta_one,
+                                         const double eta_two,
+                                         const double beta,
+                                         const double energy,
+                                         int *__restrict thread_counts,
+                                         double *__restrict hist,
+                                         const double cut_left,
+                                         const double cut_right,
+                                         const int n_slices,
+                                         const int n_macroparticles);
+        void kick_drift_histogram(const int index);
+
         void track();
         void rf_voltage_calculation(int turn, Slices *slices);
 
+        // Time coordinate of the synchronous particle at the given turn
+        double synchronous_dt(const int turn) const;
+        // Switches the beam to the given precision; in single precision dt
+        // is stored relative to the synchronous particle of this section
+        void set_precision(const ParticleStorage::precision_t precision);
+
+        // Difference between single and double precision tracking of the
+        // same particles, absolute errors in [s] and [eV]
+        struct precision_report_t {
+            int n_turns;
+            double max_dt_error;
+            double rms_dt_error;
+            double max_dE_error;
+            double rms_dE_error;
+            double mean_dt_error;
+            double mean_dE_error;
+            double sigma_dt_error;
+            double sigma_dE_error;
+        };
+        // Tracks copies of the beam in double and single precision for
+        // n_turns from the current turn and compares them. Only the RF kick
+        // and drift are applied and the beam and the counter are left
+        // untouched, so it can be run before committing to single precision.
+        precision_report_t validate_precision(const int n_turns);
+
+        // Kicks by linear interpolation in the RF voltage, tabulated once
+        // per change of voltage, omega_rf or phi_rf, instead of summing the
+        // harmonics per particle. max_error [eV] bounds the interpolation
+        // error per turn, 0 switches back to the direct kick. The harmonics
+        // must be multiples of the lowest one, otherwise the direct kick
+        // is used.
+        void set_tabulated_kick(const double max_error);
+        double tabulated_kick_error;
+        // Number of intervals of the current table, 0 if not in use
+        int tabulated_kick_points() const { return fKickTablePoints; }
+
         inline void horizontal_cut();
         RingAndRfSection(RfParameters *RfP = Context::RfP,
                          Beams *Beam = Context::Beam,
@@ -86,7 +196,9 @@ namespace blond {
                          LHCNoiseFB *NoiseFB = nullptr, bool periodicity = false,
                          double dE_max = 0, bool rf_kick_interp = false,
                          Slices *Slices = nullptr,
-                         TotalInducedVoltage *TotalInducedVoltage = nullptr)
+                         TotalInducedVoltage *TotalInducedVoltage = nullptr,
+                         bool fused_slicing = false,
+                         bool fast_reciprocal = false)
             : section_index(RfP->section_index),
               counter(RfP->counter),
               length_ratio(RfP->length_ratio),
@@ -118,6 +230,12 @@ namespace blond {
             this->rf_kick_interp = rf_kick_interp;
             this->slices = Slices;
             this->totalInducedVoltage = TotalInducedVoltage;
+            this->fused_slicing = fused_slicing;
+            this->fast_reciprocal = fast_reciprocal;
+            this->tabulated_kick_error = 0.;
+            this->fKickTableInvStep = 0.;
+            this->fKickTablePoints = 0;
+            this->fTabulatedTurn = false;
 
             this->acceleration_kick.resize(rfp->E_increment.size());
             for (uint i = 0; i < rfp->E_increment.size(); ++i)
@@ -137,12 +255,93 @@ namespace blond {
                 exit(-1);
             }
 
+            if (fused_slicing && Slices == NULL) {
+                std::cerr << "ERROR: A slices object is needed to use the"
+                          << " fused_slicing option\n";
+                exit(-1);
+            }
+
+            fVoltageBuffer.resize(n_rf);
+            fOmegaBuffer.resize(n_rf);
+            fPhiBuffer.resize(n_rf);
+            if (periodicity) {
+                const int n = Beam->n_macroparticles;
+                indices_right_outside.reserve(n);
+                indices_inside_frame.reserve(n);
+                indices_left_outside.reserve(n);
+                insiders_dt.reserve(n);
+                insiders_dE.reserve(n);
+                left_dt.reserve(n);
+                left_dE.reserve(n);
+            }
+
         }
         ~RingAndRfSection() {};
+
+    private:
+        // Per turn scratch of kick() and rf_voltage_calculation()
+        f_vector_t fVoltageBuffer;
+        f_vector_t fOmegaBuffer;
+        f_vector_t fPhiBuffer;
+        f_vector_t fPhaseBuffer;
+        void load_rf_parameters(const int index, const double dt_reference);
+
+        // Value and slope to the next point, per interval of one period of
+        // the RF voltage, and the RF parameters it was built from
+        f_vector_t fKickTable;
+        f_vector_t fKickTableKey;
+        double fKickTableInvStep;
+        int fKickTablePoints;
+        bool update_kick_table();
+
+        // Block by block tracking of consecutive sections by FullRingAndRf.
+        // A section qualifies when its turn is only a kick and a drift.
+        friend class FullRingAndRf;
+        bool fTabulatedTurn;
+        void apply_phi_noise();
+        bool kick_drift_only() const;
+        // Loads the RF parameters of the current turn for kick_drift_block()
+        void prepare_kick_drift();
+        template <typename real_t>
+        void kick_drift_block(real_t *__restrict beam_dt,
+                              real_t *__restrict beam_dE,
+                              const int start, const int end) const;
+
+        // Per thread offsets of partition_indices()
+        int_vector_t fPartitionOffsets;
+        template <int N, typename F>
+        void partition_indices(const int n, F class_of, int_vector_t *out[N]);
+        // Copies the coordinates of the given particles to dt, dE and back
+        void gather(const int_vector_t &indices, const double shift,
+                    f_vector_t &dt, f_vector_t &dE);
+        void scatter(const int_vector_t &indices, const f_vector_t &dt,
+                     const f_vector_t &dE);
+
+        template <typename real_t>
+        void kick_span(span_t<const real_t> beam_dt, span_t<real_t> beam_dE,
+                       const int index, const double dt_reference);
+        template <typename real_t>
+        void drift_span(span_t<real_t> beam_dt, span_t<const real_t> beam_dE,
+                        const int index);
+        template <typename real_t>
+        void kick_drift_span(span_t<real_t> beam_dt, span_t<real_t> beam_dE,
+                             const int index, const double dt_reference);
+        template <typename real_t>
+        void kick_drift_histogram(span_t<real_t> beam_dt,
+                                  span_t<real_t> beam_dE, const int index,
+                                  const double dt_reference);
     };
 
     class FullRingAndRf {
     private:
+        // Tracks the sections [first, last) one cache-sized block of
+        // particles at a time through all of them
+        void track_blocks(const int first, const int last);
+        template <typename real_t>
+        void track_blocks(real_t *__restrict beam_dt,
+                          real_t *__restrict beam_dE,
+                          const int n_macroparticles,
+                          const int first, const int last);
     public:
         enum main_harmonic_t { lowest_freq = 0, highest_voltage = 1 };
 
@@ -30,8 +30,8 @@ namespace blond {
     std::vector<int> is_in_separatrix(const GeneralParameters *GP,
                                       const RfParameters *RfP,
                                       const Beams *Beam,
-                                      const f_vector_t &dt,
-                                      const f_vector_t &dE,
+                                      span_t<const double> dt,
+                                      span_t<const double> dE,
                                       const f_vector_t total_voltage = {});
 
     f_vector_t hamiltonian(const GeneralParameters *GP,
@@ -8,6 +8,7 @@
 #include <blond/beams/Beams.h>
 #include <blond/constants.h>
 #include <blond/math_functions.h>
+#include <blond/openmp.h>
 #include <blond/trackers/utilities.h>
 
 using namespace blond;
@@ -15,6 +16,7 @@ using namespace blond;
 Beams::Beams(GeneralParameters *GP,
              const int _n_macroparticles,
              const long long _intensity)
+    : ParticleStorage(_n_macroparticles)
 {
     mass = GP->mass;
     charge = GP->charge;
@@ -24,14 +26,13 @@ Beams::Beams(GeneralParameters *GP,
     momentum = GP->momentum[0][0];
     n_macroparticles = _n_macroparticles;
     intensity = _intensity;
-    dt.resize(n_macroparticles);
-    dE.resize(n_macroparticles);
-    id.resize(n_macroparticles, 1);
     mean_dt = mean_dE = 0;
     sigma_dt = sigma_dE = 0;
     ratio = intensity / n_macroparticles;
     epsn_rms_l = 0;
     n_macroparticles_lost = 0;
+    stream_statistics = false;
+    statistics_streamed = false;
 }
 
 Beams::~Beams() {}
@@ -43,59 +44,82 @@ uint Beams::n_macroparticles_alive()
 
 void Beams::statistics()
 {
-    statistics(dE.data(), dt.data(), id.data(), dE.size());
+    if (precision == single_precision) {
+        statistics(dE_f.data(), dt_f.data(), id.data(), size());
+        mean_dt += dt_reference;
+    } else
+        statistics(dE.data(), dt.data(), id.data(), size());
 }
 
-void Beams::statistics(const double *__restrict dE,
-                       const double *__restrict dt,
+// One pass over the beam, the moments are kept in double for either storage
+// precision. The partial moments are merged in thread order so that the
+// result does not depend on the scheduling.
+template <typename T>
+void Beams::statistics(const T *__restrict dE,
+                       const T *__restrict dt,
                        const int *__restrict id,
                        const int size)
 {
-    double m_dE, m_dt, s_dE, s_dt;
-    m_dt = m_dE = s_dE = s_dt = 0.0;
-    int n = 0;
-
-    #pragma omp parallel for reduction(+:m_dE, m_dt, n)
-    for (int i = 0; i < size; ++i) {
-        m_dE += id[i] * dE[i];
-        m_dt += id[i] * dt[i];
-        n += id[i];
+    std::vector<bunch_moments_t> partial(omp_get_max_threads());
+
+    #pragma omp parallel
+    {
+        bunch_moments_t &moments = partial[omp_get_thread_num()];
+        #pragma omp for schedule(static)
+        for (int start = 0; start < size; start += STATISTICS_BLOCK_SIZE)
+            moments.add_block(dt, dE, id, start,
+                              std::min(start + STATISTICS_BLOCK_SIZE, size));
     }
 
-    mean_dE = m_dE /= n;
-    mean_dt = m_dt /= n;
+    bunch_moments_t total;
+    for (const auto &moments : partial)
+        total.merge(moments);
+    set_statistics(total);
+}
 
-    #pragma omp parallel for reduction(+:s_dE, s_dt)
-    for (int i = 0; i < size; ++i) {
-        s_dE += id[i] * (dE[i] - mean_dE) * (dE[i] - mean_dE);
-        s_dt += id[i] * (dt[i] - mean_dt) * (dt[i] - mean_dt);
-    }
-    sigma_dE = std::sqrt(s_dE / n);
-    sigma_dt = std::sqrt(s_dt / n);
+void Beams::set_statistics(const bunch_moments_t &moments)
+{
+    const double n = moments.n;
+    mean_dt = moments.mean_dt;
+    mean_dE = moments.mean_dE;
+    sigma_dE = std::sqrt(moments.m2_dE / n);
+    sigma_dt = std::sqrt(moments.m2_dt / n);
     epsn_rms_l = constant::pi * sigma_dE * sigma_dt; // in eVs
     // Losses
-    n_macroparticles_lost = n_macroparticles - n;
-
+    n_macroparticles_lost = n_macroparticles - (int) n;
 }
 
 
-void Beams::losses_longitudinal_cut(const double dt_min, const double dt_max)
+template <typename T>
+static void losses_cut(const T *__restrict coord, int *__restrict id,
+                       const double c_min, const double c_max, const int size)
 {
     #pragma omp parallel for
-    for (int i = 0; i < (int)n_macroparticles; i++)
-        id[i] = (dt[i] - dt_min) * (dt_max - dt[i]) < 0 ? 0 : id[i];
+    for (int i = 0; i < size; i++)
+        id[i] = (coord[i] - c_min) * (c_max - coord[i]) < 0 ? 0 : id[i];
+}
+
+void Beams::losses_longitudinal_cut(const double dt_min, const double dt_max)
+{
+    if (precision == single_precision)
+        losses_cut(dt_f.data(), id.data(), dt_min - dt_reference,
+                   dt_max - dt_reference, n_macroparticles);
+    else
+        losses_cut(dt.data(), id.data(), dt_min, dt_max, n_macroparticles);
 }
 
 void Beams::losses_energy_cut(const double dE_min, const double dE_max)
 {
-    #pragma omp parallel for
-    for (int i = 0; i < (int)n_macroparticles; ++i)
-        id[i] = (dE[i] - dE_min) * (dE_max - dE[i]) < 0 ? 0 : id[i];
+    if (precision == single_precision)
+        losses_cut(dE_f.data(), id.data(), dE_min, dE_max, n_macroparticles);
+    else
+        losses_cut(dE.data(), id.data(), dE_min, dE_max, n_macroparticles);
 }
 
 
 void Beams::losses_separatrix(GeneralParameters *GP, RfParameters *RfP)
 {
+    require_double_precision("Beams::losses_separatrix");
     auto index = is_in_separatrix(GP, RfP, this, dt, dE);
     #pragma omp parallel for
     for (int i = 0; i < (int) n_macroparticles; i++)
@@ -0,0 +1,233 @@
+/*
+ * ParticleStorage.cpp
+ */
+
+#include <blond/beams/ParticleStorage.h>
+#include <blond/openmp.h>
+#include <algorithm>
+#include <iostream>
+
+using namespace blond;
+
+// After a resize the vector may hold a larger capacity than its size, so the
+// tail of the last SIMD vector is zeroed here, the allocator only zeroes
+// what lies past the capacity
+template <typename T>
+static void zero_padding(aligned_vector_t<T> &v)
+{
+    const int n = v.size();
+    std::memset(v.data() + n, 0, (simd_padded_size<T>(n) - n) * sizeof(T));
+}
+
+ParticleStorage::ParticleStorage(const int n_particles)
+{
+    precision = double_precision;
+    dt_reference = 0.;
+    resize(n_particles);
+}
+
+ParticleStorage::~ParticleStorage() {}
+
+void ParticleStorage::resize(const int n_particles)
+{
+    if (precision == double_precision) {
+        dt.resize(n_particles);
+        dE.resize(n_particles);
+        zero_padding(dt);
+        zero_padding(dE);
+    } else {
+        dt_f.resize(n_particles);
+        dE_f.resize(n_particles);
+        zero_padding(dt_f);
+        zero_padding(dE_f);
+    }
+    id.resize(n_particles, 1);
+    zero_padding(id);
+}
+
+void ParticleStorage::set_precision(const precision_t new_precision,
+                                    const double reference)
+{
+    if (new_precision == precision) {
+        if (precision == double_precision || reference == dt_reference)
+            return;
+        // new reference, go through double to keep the rounding to a
+        // single step
+        set_precision(double_precision);
+    }
+
+    const int n = size();
+    if (new_precision == single_precision) {
+        dt_f.resize(n);
+        dE_f.resize(n);
+        #pragma omp parallel for
+        for (int i = 0; i < n; ++i) {
+            dt_f[i] = dt[i] - reference;
+            dE_f[i] = dE[i];
+        }
+        aligned_vector_t<double>().swap(dt);
+        aligned_vector_t<double>().swap(dE);
+        dt_reference = reference;
+    } else {
+        dt.resize(n);
+        dE.resize(n);
+        #pragma omp parallel for
+        for (int i = 0; i < n; ++i) {
+            dt[i] = dt_f[i] + dt_reference;
+            dE[i] = dE_f[i];
+        }
+        aligned_vector_t<float>().swap(dt_f);
+        aligned_vector_t<float>().swap(dE_f);
+        dt_reference = 0.;
+    }
+    precision = new_precision;
+}
+
+void ParticleStorage::require_double_precision(const std::string &caller) const
+{
+    if (precision != double_precision) {
+        std::cerr << "ERROR: " << caller << " needs the particle coordinates"
+                  << " in double precision, call set_precision() first\n";
+        exit(-1);
+    }
+}
+
+// Bits of the key sorted per pass of sort_by_dt(), two passes for the
+// 32 bits of quantised dt
+const int SORT_RADIX_BITS = 16;
+const int SORT_RADIX = 1 << SORT_RADIX_BITS;
+// Bits of the quantised dt, past them the runs of equal keys are short
+const int SORT_KEY_BITS = 32;
+// Longest run of equal keys that sort_by_dt() finishes with an insertion
+// sort, longer ones go to std::stable_sort
+const int SORT_INSERTION_RUN = 32;
+
+// Unsigned integer with the order of the double, the sign bit is flipped
+// for positive numbers and all bits for negative ones
+static inline uint64_t ordered_bits(const double x)
+{
+    uint64_t u;
+    std::memcpy(&u, &x, sizeof(u));
+    return u ^ ((uint64_t)((int64_t)u >> 63) | 0x8000000000000000ULL);
+}
+
+void ParticleStorage::sort_by_dt()
+{
+    require_double_precision("ParticleStorage::sort_by_dt");
+
+    const int n = size();
+    if (n < 2) return;
+
+    int inversions = 0;
+    uint64_t bits_or = 0;
+    uint64_t bits_and = ~0ULL;
+    #pragma omp parallel for reduction(+ : inversions) \
+    reduction(| : bits_or) reduction(& : bits_and)
+    for (int i = 0; i < n; ++i) {
+        inversions += i > 0 && dt[i] < dt[i - 1];
+        const uint64_t b = ordered_bits(dt[i]);
+        bits_or |= b;
+        bits_and &= b;
+    }
+    if (inversions == 0) return;
+
+    // dt is quantised to its leading bits that differ between the
+    // particles, a far away particle only coarsens the key
+    const uint64_t varying = bits_or ^ bits_and;
+    int top = 63;
+    while (!(varying >> top)) --top;
+    const int key_shift = std::max(0, top + 1 - SORT_KEY_BITS);
+    const uint32_t key_varying = varying >> key_shift;
+
+    fSortRecords.resize(n);
+    fSortRecordsTmp.resize(n);
+    sort_record_t *rec = fSortRecords.data();
+    sort_record_t *rec_tmp = fSortRecordsTmp.data();
+
+    #pragma omp parallel
+    {
+        const int tid = omp_get_thread_num();
+        const int threads = omp_get_num_threads();
+        const int chunk = (n + threads - 1) / threads;
+        const int start = std::min(tid * chunk, n);
+        const int end = std::min(start + chunk, n);
+
+        #pragma omp single
+        fSortOffsets.resize(threads * SORT_RADIX);
+
+        for (int i = start; i < end; ++i) {
+            rec[i].key = ordered_bits(dt[i]) >> key_shift;
+            rec[i].id = id[i];
+            rec[i].dt = dt[i];
+            rec[i].dE = dE[i];
+        }
+
+        // Every pass is a stable counting sort on one digit, the chunks of
+        // the threads are laid out in order within a digit. A digit that
+        // all the keys share needs no pass.
+        int *offset = &fSortOffsets[tid * SORT_RADIX];
+        for (int shift = 0; shift < SORT_KEY_BITS; shift += SORT_RADIX_BITS) {
+            if (((key_varying >> shift) & (SORT_RADIX - 1)) == 0) continue;
+
+            std::fill_n(offset, SORT_RADIX, 0);
+            for (int i = start; i < end; ++i)
+                offset[(rec[i].key >> shift) & (SORT_RADIX - 1)]++;
+
+            #pragma omp barrier
+            #pragma omp single
+            {
+                int sum = 0;
+                for (int d = 0; d < SORT_RADIX; ++d)
+                    for (int th = 0; th < threads; ++th) {
+                        const int count = fSortOffsets[th * SORT_RADIX + d];
+                        fSortOffsets[th * SORT_RADIX + d] = sum;
+                        sum += count;
+                    }
+            }
+
+            for (int i = start; i < end; ++i)
+                rec_tmp[offset[(rec[i].key >> shift) & (SORT_RADIX - 1)]++]
+                    = rec[i];
+
+            #pragma omp barrier
+            #pragma omp single
+            std::swap(rec, rec_tmp);
+        }
+
+        // Only the particles of a run of equal keys may still be out of
+        // order, a thread finishes the runs that start in its chunk. The
+        // runs keep the order of the previous call, so the insertion sort
+        // of a short run is cheap, a long one is left to std::stable_sort.
+        auto by_dt = [](const sort_record_t &a, const sort_record_t &b) {
+            return a.dt < b.dt;
+        };
+        int run = start;
+        while (run > 0 && run < end && rec[run].key == rec[run - 1].key)
+            ++run;
+        while (run < end) {
+            int run_end = run + 1;
+            while (run_end < n && rec[run_end].key == rec[run].key) ++run_end;
+
+            if (run_end - run > SORT_INSERTION_RUN) {
+                std::stable_sort(rec + run, rec + run_end, by_dt);
+            } else {
+                for (int i = run + 1; i < run_end; ++i) {
+                    if (!by_dt(rec[i], rec[i - 1])) continue;
+                    const sort_record_t r = rec[i];
+                    int j = i;
+                    for (; j > run && by_dt(r, rec[j - 1]); --j)
+                        rec[j] = rec[j - 1];
+                    rec[j] = r;
+                }
+            }
+            run = run_end;
+        }
+
+        #pragma omp barrier
+        for (int i = start; i < end; ++i) {
+            dt[i] = rec[i].dt;
+            dE[i] = rec[i].dE;
+            id[i] = rec[i].id;
+        }
+    }
+}
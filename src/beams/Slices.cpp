@@ -8,7 +8,6 @@
 #include <blond/globals.h>
 #include <blond/math_functions.h>
 #include <blond/fft.h>
-#include <blond/python.h>
 #include <blond/vector_math.h>
 
 using namespace blond;
@@ -17,7 +16,7 @@ using namespace std;
 Slices::Slices(RfParameters *RfP, Beams *Beam, int n_slices,
                int n_sigma, double cut_left, double cut_right,
                cuts_unit_t cuts_unit, fit_t fit_option,
-               bool direct_slicing)
+               bool direct_slicing, deposit_t deposit)
 {
     beam = Beam;
     rfp = RfP;
@@ -26,27 +25,35 @@ Slices::Slices(RfParameters *RfP, Beams *Beam, int n_slices,
     this->cut_right = cut_right;
     this->cuts_unit = cuts_unit;
     this->fit_option = fit_option;
+    this->deposit = deposit;
     this->n_sigma = n_sigma;
     this->n_macroparticles.resize(n_slices, 0);
     this->edges.resize(n_slices + 1, 0.0);
     this->bin_centers.resize(n_slices, 0.0);
-    this->thread_hist = (double *) malloc(n_slices * omp_get_max_threads()
-                                          * sizeof(double));
-    
+    this->thread_hist.resize((n_slices + 2 * SPLINE_PADDING)
+                             * omp_get_max_threads());
+    this->thread_counts.resize((n_slices + 1) * omp_get_max_threads());
+    this->thread_moments.resize(omp_get_max_threads());
+    bl_gauss = 0.0;
+    bp_gauss = 0.0;
+    n_slices_bunch = 0;
+    bunch_bin_width = 0.0;
+    adaptive_frame = false;
+    frame_n_sigma = 0.0;
+    frame_min_slices = frame_max_slices = n_slices;
+    frame_statistics_streamed = false;
+    fSpectrumN = fSpectrumFilled = 0;
+    fSpectrumDt = 0.0;
 
     set_cuts();
+    frame_bin_width = (this->cut_right - this->cut_left) / n_slices;
 
-    if (fit_option == gaussian) {
-        bl_gauss = 0.0;
-        bp_gauss = 0.0;
-    }
     if (direct_slicing) track();
 }
 
 Slices::~Slices()
 {
     fft::destroy_plans();
-    if (thread_hist) free(thread_hist);
 }
 
 void Slices::set_cuts()
@@ -69,9 +76,17 @@ void Slices::set_cuts()
             cut_right =
                 beam->dt.back() + 0.05 * (beam->dt.back() - beam->dt.front());
         } else {
-            double mean_coords = mymath::mean(beam->dt.data(), beam->dt.size());
-            double sigma_coords = mymath::standard_deviation(
-                                      beam->dt.data(), beam->dt.size(), mean_coords);
+            double mean_coords, sigma_coords;
+            if (beam->precision == ParticleStorage::single_precision) {
+                mean_coords = mymath::mean(beam->dt_f.data(), beam->dt_f.size());
+                sigma_coords = mymath::standard_deviation(
+                                   beam->dt_f.data(), beam->dt_f.size(), mean_coords);
+                mean_coords += beam->dt_reference;
+            } else {
+                mean_coords = mymath::mean(beam->dt.data(), beam->dt.size());
+                sigma_coords = mymath::standard_deviation(
+                                   beam->dt.data(), beam->dt.size(), mean_coords);
+            }
             cut_left = mean_coords - n_sigma * sigma_coords / 2;
             cut_right = mean_coords + n_sigma * sigma_coords / 2;
         }
@@ -90,28 +105,8 @@ void Slices::sort_particles()
     /*
     *Sort the particles with respect to their position.*
     */
-
-    struct particle {
-        double dE;
-        double dt;
-        int id;
-        bool operator<(const particle &other) const
-        {
-            return dt < other.dt;
-        }
-    };
-
-    std::vector<particle> particles(beam->dE.size());
-    for (uint i = 0; i < particles.size(); i++)
-        particles[i] = {beam->dE[i], beam->dt[i], beam->id[i]};
-
-    std::sort(particles.begin(), particles.end());
-
-    for (uint i = 0; i < particles.size(); i++) {
-        beam->dE[i] = particles[i].dE;
-        beam->dt[i] = particles[i].dt;
-        beam->id[i] = particles[i].id;
-    }
+    beam->require_double_precision("Slices::sort_particles");
+    beam->sort_by_dt();
 }
 
 double Slices::convert_coordinates(const double cut,
@@ -129,9 +124,27 @@ double Slices::convert_coordinates(const double cut,
 
 void Slices::track()
 {
-    slice_constant_space_histogram();
+    if (adaptive_frame)
+        track_frame();
+
+    switch (deposit) {
+        case linear:
+            slice_constant_space_histogram_smooth();
+            break;
+        case tsc:
+            slice_constant_space_histogram_tsc();
+            break;
+        case cubic:
+            slice_constant_space_histogram_cubic();
+            break;
+        default:
+            slice_constant_space_histogram();
+            break;
+    }
     if (fit_option == fit_t::gaussian)
         gaussian_fit();
+    if (!bunch_pattern.empty())
+        slice_multibunch();
 }
 
 void Slices::slice_constant_space_histogram()
@@ -145,43 +158,77 @@ void Slices::slice_constant_space_histogram()
     for high number of particles (~1e6).*
     */
 
-    histogram(beam->dt.data(), n_macroparticles.data(), cut_left, cut_right,
-              n_slices, beam->n_macroparticles);
+    if (beam->stream_statistics) {
+        if (beam->precision == ParticleStorage::single_precision) {
+            histogram_statistics(beam->dt_f.data(), beam->dE_f.data(),
+                                 beam->id.data(), n_macroparticles.data(),
+                                 cut_left - beam->dt_reference,
+                                 cut_right - beam->dt_reference,
+                                 n_slices, beam->n_macroparticles);
+            publish_statistics(beam->dt_reference);
+        } else {
+            histogram_statistics(beam->dt.data(), beam->dE.data(),
+                                 beam->id.data(), n_macroparticles.data(),
+                                 cut_left, cut_right, n_slices,
+                                 beam->n_macroparticles);
+            publish_statistics();
+        }
+    } else if (beam->precision == ParticleStorage::single_precision)
+        histogram(beam->dt_f.data(), n_macroparticles.data(),
+                  cut_left - beam->dt_reference, cut_right - beam->dt_reference,
+                  n_slices, beam->n_macroparticles);
+    else
+        histogram(beam->dt.data(), n_macroparticles.data(), cut_left,
+                  cut_right, n_slices, beam->n_macroparticles);
+}
+
+int blond::histogram_copies(const int n, const int n_slices,
+                            const int threads)
+{
+    if (n < HISTOGRAM_SERIAL_SIZE || threads == 1) return 1;
+    const double best = std::sqrt((double) n * threads / n_slices);
+    return std::max(1, std::min(threads, (int) best));
 }
 
-void Slices::histogram(const double *__restrict input,
+template <typename real_t>
+void Slices::histogram(const real_t *__restrict input,
                        double *__restrict output,
                        const double cut_left,
                        const double cut_right,
                        const int n_slices,
                        const int n_macroparticles)
 {
-
     const double inv_bin_width = n_slices / (cut_right - cut_left);
-    
-    #pragma omp parallel
+    const int copies = histogram_copies(n_macroparticles, n_slices,
+                                        omp_get_max_threads());
+    int used = 1;
+
+    #pragma omp parallel num_threads(copies)
     {
         const int id = omp_get_thread_num();
-        const int threads = omp_get_num_threads();
+        #pragma omp single nowait
+        used = omp_get_num_threads();
 
-        double *h_row = &thread_hist[id * n_slices];
-        memset(h_row, 0., n_slices * sizeof(double));
+        int *h_row = &thread_counts[id * (n_slices + 1)];
+        memset(h_row, 0, (n_slices + 1) * sizeof(int));
 
         #pragma omp for
         for (int i = 0; i < n_macroparticles; ++i) {
             if (input[i] < cut_left || input[i] > cut_right) continue;
-            h_row[(int)((input[i] - cut_left)*inv_bin_width)] += 1.;
-        }
-
-        #pragma omp for
-        for (int i = 0; i < n_slices; i++) {
-            output[i] = 0.;
-            for (int t = 0; t < threads; t++)
-                output[i] += thread_hist[t * n_slices + i];
+            h_row[(int)((input[i] - cut_left)*inv_bin_width)]++;
         }
     }
+
+    reduce_counts(thread_counts.data(), output, n_slices, used);
 }
 
+template void Slices::histogram<double>(const double *__restrict,
+                                        double *__restrict, const double,
+                                        const double, const int, const int);
+template void Slices::histogram<float>(const float *__restrict,
+                                       double *__restrict, const double,
+                                       const double, const int, const int);
+
 void Slices::track_cuts()
 {
     /*
@@ -198,7 +245,131 @@ void Slices::track_cuts()
     bin_centers += delta;
 }
 
-void Slices::smooth_histogram(const double *__restrict input,
+void Slices::set_adaptive_frame(const double n_sigma, const int min_slices,
+                                const int max_slices)
+{
+    if (n_sigma <= 0 || min_slices < 2 || max_slices < min_slices) {
+        std::cerr << "[set_adaptive_frame] Expected n_sigma > 0 and "
+                  << "2 <= min_slices <= max_slices\n";
+        exit(-1);
+    }
+    adaptive_frame = true;
+    frame_n_sigma = n_sigma;
+    frame_bin_width = (cut_right - cut_left) / n_slices;
+    frame_min_slices = min_slices;
+    frame_max_slices = max_slices;
+}
+
+bool Slices::track_frame()
+{
+    // Right after construction, or when the last pass did not stream,
+    // mean_dt and sigma_dt are not those of the bunch
+    if (!frame_statistics_streamed)
+        beam->statistics();
+    frame_statistics_streamed = false;
+    if (!(beam->sigma_dt > 0))
+        return false;
+
+    const int needed = std::ceil(frame_n_sigma * beam->sigma_dt
+                                 / frame_bin_width);
+
+    int n = n_slices;
+    if (needed > n_slices || needed < FRAME_SHRINK * n_slices) {
+        // The smallest regular number not below needed
+        n = mymath::next_regular(std::max(needed, frame_min_slices) - 1);
+        n = std::min(n, frame_max_slices);
+    }
+
+    const bool resized = n != n_slices;
+    resize_frame(n, beam->mean_dt);
+    return resized;
+}
+
+void Slices::resize_frame(const int n, const double center)
+{
+    if (n != n_slices) {
+        thread_hist.resize((n + 2 * SPLINE_PADDING) * omp_get_max_threads());
+        thread_counts.resize((n + 1) * omp_get_max_threads());
+        n_slices = n;
+        n_macroparticles.resize(n_slices, 0);
+        edges.resize(n_slices + 1, 0.0);
+        bin_centers.resize(n_slices, 0.0);
+    }
+
+    cut_left = center - 0.5 * n_slices * frame_bin_width;
+    cut_right = center + 0.5 * n_slices * frame_bin_width;
+    mymath::linspace(edges.data(), cut_left, cut_right, n_slices + 1);
+    for (uint i = 0; i < bin_centers.size(); ++i)
+        bin_centers[i] = (edges[i + 1] + edges[i]) / 2;
+}
+
+template <typename real_t>
+void Slices::histogram_statistics(const real_t *__restrict dt,
+                                  const real_t *__restrict dE,
+                                  const int *__restrict id,
+                                  double *__restrict output,
+                                  const double cut_left,
+                                  const double cut_right,
+                                  const int n_slices,
+                                  const int n_macroparticles)
+{
+    const double inv_bin_width = n_slices / (cut_right - cut_left);
+    const int copies = histogram_copies(n_macroparticles, n_slices,
+                                        omp_get_max_threads());
+    int used = 1;
+
+    #pragma omp parallel num_threads(copies)
+    {
+        const int tid = omp_get_thread_num();
+        #pragma omp single nowait
+        used = omp_get_num_threads();
+
+        int *h_row = &thread_counts[tid * (n_slices + 1)];
+        memset(h_row, 0, (n_slices + 1) * sizeof(int));
+        bunch_moments_t &moments = thread_moments[tid];
+
+        #pragma omp for schedule(static)
+        for (int start = 0; start < n_macroparticles;
+                start += STATISTICS_BLOCK_SIZE) {
+            const int end = std::min(start + STATISTICS_BLOCK_SIZE,
+                                     n_macroparticles);
+            for (int i = start; i < end; ++i) {
+                if (dt[i] < cut_left || dt[i] > cut_right) continue;
+                h_row[(int)((dt[i] - cut_left)*inv_bin_width)]++;
+            }
+            moments.add_block(dt, dE, id, start, end);
+        }
+    }
+
+    reduce_counts(thread_counts.data(), output, n_slices, used);
+}
+
+template void Slices::histogram_statistics<double>(const double *__restrict,
+        const double *__restrict, const int *__restrict, double *__restrict,
+        const double, const double, const int, const int);
+template void Slices::histogram_statistics<float>(const float *__restrict,
+        const float *__restrict, const int *__restrict, double *__restrict,
+        const double, const double, const int, const int);
+
+void Slices::publish_statistics(const double dt_offset)
+{
+    bunch_moments_t total;
+    for (auto &moments : thread_moments) {
+        total.merge(moments);
+        moments = bunch_moments_t();
+    }
+    total.mean_dt += dt_offset;
+    beam->set_statistics(total);
+    beam->statistics_streamed = true;
+    frame_statistics_streamed = true;
+}
+
+// Particles per pass of smooth_histogram(): the bins and weights of a
+// chunk are computed in one vectorised loop, then deposited
+const int SMOOTH_CHUNK_SIZE = 256;
+
+template <typename real_t>
+void Slices::smooth_histogram(const real_t *__restrict input,
                               double *__restrict output,
                               const double cut_left,
                               const double cut_right,
@@ -206,49 +377,175 @@ void Slices::smooth_histogram(const double *__restrict input,
                               const int n_macroparticles)
 {
 
-    int i;
-    double a;
-    double fbin;
-    double ratioffbin;
-    double ratiofffbin;
-    double distToCenter;
-    int ffbin = 0;
-    int fffbin = 0;
     const double inv_bin_width = n_slices / (cut_right - cut_left);
     const double bin_width = (cut_right - cut_left) / n_slices;
+    const double lower = cut_left + bin_width * 0.5;
+    const double upper = cut_right - bin_width * 0.5;
+    const int row = n_slices + 2 * SPLINE_PADDING;
+
+    #pragma omp parallel
+    {
+        const int id = omp_get_thread_num();
+        const int threads = omp_get_num_threads();
+
+        double *h_row = &thread_hist[id * row + SPLINE_PADDING];
+        memset(h_row, 0., n_slices * sizeof(double));
 
-    for (i = 0; i < n_slices; i++) {
-        output[i] = 0;
+        int ffbin[SMOOTH_CHUNK_SIZE];
+        int fffbin[SMOOTH_CHUNK_SIZE];
+        double ratioffbin[SMOOTH_CHUNK_SIZE];
+        int inside[SMOOTH_CHUNK_SIZE];
+
+        #pragma omp for schedule(static)
+        for (int k = 0; k < n_macroparticles; k += SMOOTH_CHUNK_SIZE) {
+            const int len = std::min(SMOOTH_CHUNK_SIZE, n_macroparticles - k);
+            const real_t *__restrict a = &input[k];
+
+            // Each particle is shared between its bin and the neighbour
+            // on the side of its offset from the bin center. The ones
+            // outside the frame are clamped so their bins stay valid. A
+            // particle that rounds past the outer half of an edge bin takes
+            // the inner neighbour instead of one outside the frame.
+            for (int i = 0; i < len; ++i) {
+                inside[i] = !(a[i] < lower || a[i] > upper);
+                const double ai = std::min(std::max((double) a[i], lower),
+                                           upper);
+                const double fbin = (ai - cut_left) * inv_bin_width;
+                ffbin[i] = (int)(fbin);
+                const double distToCenter = fbin - (double)(ffbin[i]);
+                const int nb = ffbin[i] + (distToCenter > 0.5)
+                               - (distToCenter < 0.5);
+                fffbin[i] = nb < 0 ? 1 : (nb >= n_slices ? n_slices - 2 : nb);
+                ratioffbin[i] = 0.5 - distToCenter;
+            }
+
+            for (int i = 0; i < len; ++i) {
+                if (!inside[i]) continue;
+                h_row[ffbin[i]] += ratioffbin[i];
+                h_row[fffbin[i]] += 1 - ratioffbin[i];
+            }
+        }
+
+        #pragma omp for
+        for (int i = 0; i < n_slices; i++) {
+            output[i] = 0.;
+            for (int t = 0; t < threads; t++)
+                output[i] += thread_hist[t * row + SPLINE_PADDING + i];
+        }
     }
+}
+
+template void Slices::smooth_histogram<double>(const double *__restrict,
+        double *__restrict, const double, const double, const int, const int);
+template void Slices::smooth_histogram<float>(const float *__restrict,
+        double *__restrict, const double, const double, const int, const int);
+
+template <int ORDER, typename real_t>
+void Slices::spline_histogram(const real_t *__restrict input,
+                              double *__restrict output,
+                              const double cut_left,
+                              const double cut_right,
+                              const int n_slices,
+                              const int n_macroparticles)
+{
+    const double inv_bin_width = n_slices / (cut_right - cut_left);
+    // the rows have SPLINE_PADDING bins past each edge, so the stencils
+    // of the particles near the edges need no bounds checks
+    const int row = n_slices + 2 * SPLINE_PADDING;
+
+    #pragma omp parallel
+    {
+        const int id = omp_get_thread_num();
+        const int threads = omp_get_num_threads();
 
-    for (i = 0; i < n_macroparticles; i++) {
-        a = input[i];
-        if ((a < (cut_left + bin_width * 0.5)) ||
-                (a > (cut_right - bin_width * 0.5)))
-            continue;
-        fbin = (a - cut_left) * inv_bin_width;
-        ffbin = (int)(fbin);
-        distToCenter = fbin - (double)(ffbin);
-        if (distToCenter > 0.5)
-            fffbin = (int)(fbin + 1.0);
-        ratioffbin = 1.5 - distToCenter;
-        ratiofffbin = 1 - ratioffbin;
-        if (distToCenter < 0.5)
-            fffbin = (int)(fbin - 1.0);
-        ratioffbin = 0.5 - distToCenter;
-        ratiofffbin = 1 - ratioffbin;
-        output[ffbin] = output[ffbin] + ratioffbin;
-        output[fffbin] = output[fffbin] + ratiofffbin;
+        double *h_row = &thread_hist[id * row];
+        memset(h_row, 0., row * sizeof(double));
+
+        int first[SMOOTH_CHUNK_SIZE];
+        double weight[ORDER + 1][SMOOTH_CHUNK_SIZE];
+        int inside[SMOOTH_CHUNK_SIZE];
+
+        #pragma omp for schedule(static)
+        for (int k = 0; k < n_macroparticles; k += SMOOTH_CHUNK_SIZE) {
+            const int len = std::min(SMOOTH_CHUNK_SIZE, n_macroparticles - k);
+            const real_t *__restrict a = &input[k];
+
+            for (int i = 0; i < len; ++i) {
+                inside[i] = !(a[i] < cut_left || a[i] > cut_right);
+                const double ai = std::min(std::max((double) a[i], cut_left),
+                                           cut_right);
+                double w[ORDER + 1];
+                first[i] = spline_weights<ORDER>(
+                               (ai - cut_left) * inv_bin_width - 0.5, w)
+                           + SPLINE_PADDING;
+                for (int b = 0; b <= ORDER; ++b)
+                    weight[b][i] = w[b];
+            }
+
+            for (int i = 0; i < len; ++i) {
+                if (!inside[i]) continue;
+                for (int b = 0; b <= ORDER; ++b)
+                    h_row[first[i] + b] += weight[b][i];
+            }
+        }
+
+        #pragma omp for
+        for (int i = 0; i < n_slices; i++) {
+            output[i] = 0.;
+            for (int t = 0; t < threads; t++)
+                output[i] += thread_hist[t * row + SPLINE_PADDING + i];
+        }
     }
 }
 
+template void Slices::spline_histogram<2, double>(const double *__restrict,
+        double *__restrict, const double, const double, const int, const int);
+template void Slices::spline_histogram<2, float>(const float *__restrict,
+        double *__restrict, const double, const double, const int, const int);
+template void Slices::spline_histogram<3, double>(const double *__restrict,
+        double *__restrict, const double, const double, const int, const int);
+template void Slices::spline_histogram<3, float>(const float *__restrict,
+        double *__restrict, const double, const double, const int, const int);
+
 void Slices::slice_constant_space_histogram_smooth()
 {
     /*
-    At the moment 4x slower than slice_constant_space_histogram but smoother.
+    Linear deposit, smoother than slice_constant_space_histogram.
     */
-    smooth_histogram(beam->dt.data(), n_macroparticles.data(), cut_left,
-                     cut_right, n_slices, beam->n_macroparticles);
+    if (beam->precision == ParticleStorage::single_precision)
+        smooth_histogram(beam->dt_f.data(), n_macroparticles.data(),
+                         cut_left - beam->dt_reference,
+                         cut_right - beam->dt_reference,
+                         n_slices, beam->n_macroparticles);
+    else
+        smooth_histogram(beam->dt.data(), n_macroparticles.data(), cut_left,
+                         cut_right, n_slices, beam->n_macroparticles);
+}
+
+void Slices::slice_constant_space_histogram_tsc()
+{
+    if (beam->precision == ParticleStorage::single_precision)
+        spline_histogram<2>(beam->dt_f.data(), n_macroparticles.data(),
+                            cut_left - beam->dt_reference,
+                            cut_right - beam->dt_reference,
+                            n_slices, beam->n_macroparticles);
+    else
+        spline_histogram<2>(beam->dt.data(), n_macroparticles.data(),
+                            cut_left, cut_right, n_slices,
+                            beam->n_macroparticles);
+}
+
+void Slices::slice_constant_space_histogram_cubic()
+{
+    if (beam->precision == ParticleStorage::single_precision)
+        spline_histogram<3>(beam->dt_f.data(), n_macroparticles.data(),
+                            cut_left - beam->dt_reference,
+                            cut_right - beam->dt_reference,
+                            n_slices, beam->n_macroparticles);
+    else
+        spline_histogram<3>(beam->dt.data(), n_macroparticles.data(),
+                            cut_left, cut_right, n_slices,
+                            beam->n_macroparticles);
 }
 
 void Slices::rms()
@@ -343,18 +640,243 @@ void Slices::fwhm(const double shift)
 //     return cfwhm * (bin_centers[taux2] - bin_centers[taux1]);
 // }
 
-void Slices::fwhm_multibunch()
+void Slices::set_bunch_pattern(const int_vector_t &buckets,
+                               const int n_slices_bunch)
+{
+    if (!buckets.empty() && n_slices_bunch < 2) {
+        std::cerr << "[set_bunch_pattern] At least 2 slices per bunch "
+                  << "are needed\n";
+        exit(-1);
+    }
+    for (const auto &b : buckets)
+        if (b < 0) {
+            std::cerr << "[set_bunch_pattern] Negative RF bucket " << b
+                      << "\n";
+            exit(-1);
+        }
+
+    const int n_bunches = buckets.size();
+    bunch_pattern = buckets;
+    this->n_slices_bunch = n_slices_bunch;
+    bunch_profiles.assign(n_bunches * n_slices_bunch, 0.);
+    bunch_cut_left.assign(n_bunches, 0.);
+    bl_fwhm_bbb.assign(n_bunches, 0.);
+    bp_fwhm_bbb.assign(n_bunches, 0.);
+    bl_rms_bbb.assign(n_bunches, 0.);
+    bp_rms_bbb.assign(n_bunches, 0.);
+    fBunchThreadCounts.resize(n_bunches * n_slices_bunch
+                              * omp_get_max_threads());
+
+    const int n_buckets = buckets.empty() ? 0 :
+                          *std::max_element(ALL(buckets)) + 1;
+    fBucketBunch.assign(n_buckets, -1);
+    for (int b = 0; b < n_bunches; b++)
+        fBucketBunch[buckets[b]] = b;
+}
+
+void Slices::slice_multibunch()
+{
+    // The buckets of the turn, as in LHCNoiseFB::fwhm_multi_bunch()
+    const double omega_rf = rfp->omega_rf[0][rfp->counter];
+    const double bucket_start = rfp->phi_rf[0][rfp->counter] / omega_rf;
+    const double bucket_length = 2 * constant::pi / omega_rf;
+
+    bunch_bin_width = bucket_length / n_slices_bunch;
+    for (int b = 0; b < n_bunches(); b++)
+        bunch_cut_left[b] = bucket_start + bunch_pattern[b] * bucket_length;
+
+    if (beam->precision == ParticleStorage::single_precision)
+        bunch_histogram(beam->dt_f.data(), bucket_start - beam->dt_reference,
+                        bucket_length, beam->n_macroparticles);
+    else
+        bunch_histogram(beam->dt.data(), bucket_start, bucket_length,
+                        beam->n_macroparticles);
+}
+
+template <typename real_t>
+void Slices::bunch_histogram(const real_t *__restrict input,
+                             const double bucket_start,
+                             const double bucket_length,
+                             const int n_macroparticles)
+{
+    const int n_buckets = fBucketBunch.size();
+    const int row = n_bunches() * n_slices_bunch;
+    const double inv_bucket_length = 1. / bucket_length;
+    const int *__restrict bucket_bunch = fBucketBunch.data();
+    double *__restrict output = bunch_profiles.data();
+    const int copies = histogram_copies(n_macroparticles, row,
+                                        omp_get_max_threads());
+    int used = 1;
+
+    #pragma omp parallel num_threads(copies)
+    {
+        const int tid = omp_get_thread_num();
+        #pragma omp single nowait
+        used = omp_get_num_threads();
+
+        int *h_row = &fBunchThreadCounts[tid * row];
+        memset(h_row, 0, row * sizeof(int));
+
+        #pragma omp for
+        for (int i = 0; i < n_macroparticles; ++i) {
+            const double x = (input[i] - bucket_start) * inv_bucket_length;
+            if (!(x >= 0. && x < n_buckets)) continue;
+            const int k = (int) x;
+            const int b = bucket_bunch[k];
+            if (b < 0) continue;
+            const int j = std::min((int)((x - k) * n_slices_bunch),
+                                   n_slices_bunch - 1);
+            h_row[b * n_slices_bunch + j]++;
+        }
+    }
+
+    #pragma omp parallel for if (used > 1)
+    for (int i = 0; i < row; i++) {
+        int count = 0;
+        for (int t = 0; t < used; t++)
+            count += fBunchThreadCounts[t * row + i];
+        output[i] = count;
+    }
+}
+
+template void Slices::bunch_histogram<double>(const double *__restrict,
+        const double, const double, const int);
+template void Slices::bunch_histogram<float>(const float *__restrict,
+        const double, const double, const int);
+
+// fwhm() of every bunch profile
+void Slices::fwhm_multibunch(const double shift)
 {
+    const int n = n_slices_bunch;
+    const double width = bunch_bin_width;
+
+    #pragma omp parallel for
+    for (int b = 0; b < n_bunches(); b++) {
+        const double *profile = &bunch_profiles[b * n];
+        const double center = bunch_cut_left[b] + 0.5 * width;
+        const double max = *std::max_element(profile, profile + n);
+        const double half_max = shift + 0.5 * (max - shift);
+
+        int taux1 = 0;
+        while (taux1 < n && profile[taux1] < half_max) taux1++;
+        const int prev1 = taux1 > 0 ? taux1 - 1 : n - 1;
+        int taux2 = n - 1;
+        while (taux2 >= 0 && profile[taux2] < half_max) taux2--;
+
+        if (taux1 < n && taux2 < n - 1 && taux2 >= 0) {
+            const double t1 = center + taux1 * width
+                              - (profile[taux1] - half_max)
+                              / (profile[taux1] - profile[prev1]) * width;
+            const double t2 = center + taux2 * width
+                              + (profile[taux2] - half_max)
+                              / (profile[taux2] - profile[taux2 + 1]) * width;
+            bl_fwhm_bbb[b] = 4 * (t2 - t1) / cfwhm;
+            bp_fwhm_bbb[b] = (t1 + t2) / 2;
+        } else {
+            bl_fwhm_bbb[b] = nan("");
+            bp_fwhm_bbb[b] = nan("");
+        }
+    }
+}
+
+// rms() of every bunch profile, with the trapezoid rule on its frame
+void Slices::rms_multibunch()
+{
+    const int n = n_slices_bunch;
+    const double width = bunch_bin_width;
+
+    #pragma omp parallel for
+    for (int b = 0; b < n_bunches(); b++) {
+        const double *profile = &bunch_profiles[b * n];
+        const double center = bunch_cut_left[b] + 0.5 * width;
+
+        // Trapezoid weights, half at the ends of the frame
+        double area = 0., mean = 0., variance = 0.;
+        for (int j = 0; j < n; j++) {
+            const double w = (j == 0 || j == n - 1) ? 0.5 : 1.;
+            area += w * profile[j];
+            mean += w * profile[j] * j;
+        }
+        mean /= area;
+        for (int j = 0; j < n; j++) {
+            const double w = (j == 0 || j == n - 1) ? 0.5 : 1.;
+            variance += w * profile[j] * (j - mean) * (j - mean);
+        }
+        variance /= area;
+        bp_rms_bbb[b] = center + mean * width;
+        bl_rms_bbb[b] = 4 * std::sqrt(variance) * width;
+    }
 }
 
 void Slices::beam_spectrum_generation(int n, bool onlyRFFT)
 {
+    const double dt = bin_centers[1] - bin_centers[0];
+    if ((int) fBeamSpectrumFreq.size() != n / 2 + 1 || dt != fSpectrumDt) {
+        fBeamSpectrumFreq = fft::rfftfreq(n, dt);
+        fSpectrumDt = dt;
+    }
 
-    fBeamSpectrumFreq = fft::rfftfreq(n, bin_centers[1] - bin_centers[0]);
+    if (onlyRFFT) return;
+
+    if (!fSpectrumPlan || n != fSpectrumN
+            || (int) fBeamSpectrum.size() != n / 2 + 1) {
+        fSpectrumInput.assign(n, 0.0);
+        fBeamSpectrum.resize(n / 2 + 1);
+        // Planned without FFTW_DESTROY_INPUT, so the zero padding past the
+        // profile is only written here
+        fSpectrumPlan = fft::init_rfft(n, fSpectrumInput.data(),
+                                       fBeamSpectrum.data(), FFTW_ESTIMATE,
+                                       Context::n_threads);
+        fSpectrumN = n;
+        fSpectrumFilled = 0;
+    }
+
+    // Cropped like numpy if the profile is longer than n, the bins left
+    // over by a shrunk adaptive frame are cleared
+    const int m = std::min(n, n_slices);
+    std::copy(n_macroparticles.begin(), n_macroparticles.begin() + m,
+              fSpectrumInput.begin());
+    if (fSpectrumFilled > m)
+        std::fill(&fSpectrumInput[m], &fSpectrumInput[fSpectrumFilled], 0.0);
+    fSpectrumFilled = m;
 
-    if (onlyRFFT == false) {
-        auto v = n_macroparticles;
-        fft::rfft(v, fBeamSpectrum, n, Context::n_threads);
+    fft::run_fft(fSpectrumPlan);
+}
+
+void Slices::beam_profile_derivative(double *__restrict derivative,
+                                     const derivative_t mode) const
+{
+    const int n = n_slices;
+    const double *__restrict profile = n_macroparticles.data();
+    const double inv_dist = 1. / (bin_centers[1] - bin_centers[0]);
+
+    if (mode == filter1d) {
+        // First derivative of a gaussian of sigma one bin, truncated at four
+        // sigma, as scipy.ndimage.gaussian_filter1d(order=1, mode='wrap')
+        const int radius = 4;
+        double weights[radius + 1];
+        double norm = 1.;
+        for (int d = 1; d <= radius; d++)
+            norm += 2. * std::exp(-0.5 * d * d);
+        for (int d = 1; d <= radius; d++)
+            weights[d] = d * std::exp(-0.5 * d * d) / norm * inv_dist;
+
+        for (int i = 0; i < n; i++) {
+            double sum = 0.;
+            for (int d = 1; d <= radius; d++) {
+                const int right = (i + d) % n;
+                const int left = ((i - d) % n + n) % n;
+                sum += weights[d] * (profile[right] - profile[left]);
+            }
+            derivative[i] = sum;
+        }
+    } else {
+        // The differences interpolated back on the bin centers are the
+        // central differences, so diff and gradient agree
+        for (int i = 1; i < n - 1; i++)
+            derivative[i] = (profile[i + 1] - profile[i - 1]) * 0.5 * inv_dist;
+        derivative[0] = (profile[1] - profile[0]) * inv_dist;
+        derivative[n - 1] = (profile[n - 1] - profile[n - 2]) * inv_dist;
     }
 }
 
@@ -362,70 +884,63 @@ void Slices::beam_profile_derivative(f_vector_t &x,
                                      f_vector_t &derivative,
                                      std::string mode)
 {
-    /*
-    The input is one of the two available methods for differentiating
-    a function. The two outputs are the coordinate step and the discrete
-    derivative of the Beam profile respectively.
-    */
-
-    x = bin_centers;
-    const auto dist_centers = x[1] - x[0];
+    derivative_t type;
     if (mode == "filter1d") {
-        derivative = gaussian_filter1d(n_macroparticles, 1, 1, "wrap");
-        for (auto &d : derivative) d /= dist_centers;
-
+        type = filter1d;
     } else if (mode == "gradient") {
-        derivative = gradient(n_macroparticles, dist_centers);
-
+        type = gradient;
     } else if (mode == "diff") {
-        derivative.resize(n_macroparticles.size() - 1);
-        for (uint i = 1; i < n_macroparticles.size(); i++)
-            derivative[i - 1] = (n_macroparticles[i] - n_macroparticles[i - 1])
-                                / dist_centers;
-        f_vector_t diffCenters(x.begin(), x.end() - 1);
-        diffCenters += dist_centers / 2.;
-        derivative = mymath::interp(x, diffCenters, derivative);
+        type = diff;
     } else {
         std::cerr << "Option for derivative is not recognized.\n";
         exit(-1);
     }
 
+    x = bin_centers;
+    derivative.resize(n_slices);
+    beam_profile_derivative(derivative.data(), type);
 }
 
 
-f_vector_t Slices::gaussian_filter1d(f_vector_t &x, int sigma,
-                                     int order, std::string mode)
+const Slices::chebyshev_filter_t &Slices::chebyshev_filter(
+    const std::map<std::string, std::string> &filter_option)
 {
-    python::import();
-    auto pFunc = python::import("utilities", "gaussian_filter1d");
-    auto pX = python::convert_double_array(x.data(), x.size());
-    auto pSigma = python::convert_int(sigma);
-    auto pOrder = python::convert_int(order);
-    auto pMode = python::convert_string(mode);
-    auto ret = PyObject_CallFunctionObjArgs(pFunc, pX, pSigma, pOrder, pMode,
-                                            NULL);
-    assert(ret);
-    auto npArray = (PyArrayObject *)(ret);
-    int len = PyArray_SHAPE(npArray)[0];
-    double *res = (double *) PyArray_DATA(npArray);
+    const double resolution = bin_centers[1] - bin_centers[0];
+    const filter_key_t key(filter_option, resolution);
+    auto it = fChebyshevFilters.find(key);
+    if (it != fChebyshevFilters.end()) return it->second;
+
+    for (const auto name : {"pass_frequency", "stop_frequency",
+                            "gain_pass", "gain_stop"
+                           }) {
+        if (filter_option.find(name) == filter_option.end()) {
+            std::cerr << "[beam_profile_filter_chebyshev] The filter option "
+                      << name << " is missing\n";
+            exit(-1);
+        }
+    }
 
-    return f_vector_t(&res[0], &res[len]);
+    const double nyq_freq = 1. / resolution / 2.;
+    const double gain_stop = std::stod(filter_option.at("gain_stop"));
+    double wn;
+    chebyshev_filter_t filter;
+    filter.order = mymath::cheb2ord(
+                       std::stod(filter_option.at("pass_frequency")) / nyq_freq,
+                       std::stod(filter_option.at("stop_frequency")) / nyq_freq,
+                       std::stod(filter_option.at("gain_pass")), gain_stop, wn);
+    mymath::cheby2(filter.order, gain_stop, wn, filter.b, filter.a);
+    mymath::lfilter_zi(filter.b, filter.a, filter.zi);
+
+    return fChebyshevFilters[key] = filter;
 }
 
-
-f_vector_t Slices::gradient(f_vector_t &x, double dist)
+int Slices::beam_profile_filter_chebyshev(const std::map<std::string,
+        std::string> &filter_option)
 {
-    python::import();
-    auto pFunc = python::import("utilities", "gradient");
-    auto pX = python::convert_double_array(x.data(), x.size());
-    auto pDist = python::convert_double(dist);
-    auto ret = PyObject_CallFunctionObjArgs(pFunc, pX, pDist, NULL);
-    assert(ret);
-
-    auto npArray = (PyArrayObject *)(ret);
-    int len = PyArray_SHAPE(npArray)[0];
-    double *res = (double *) PyArray_DATA(npArray);
-    return f_vector_t(&res[0], &res[len]);
+    const auto &filter = chebyshev_filter(filter_option);
+    mymath::filtfilt(filter.b, filter.a, filter.zi, n_macroparticles.data(),
+                     n_macroparticles.data(), n_slices, fFilterWork);
+    return filter.order;
 }
 
 // NOTE: if you specify transfer_function_plot == "true" then
@@ -434,13 +949,6 @@ f_vector_t Slices::gradient(f_vector_t &x, double dist)
 void Slices::beam_profile_filter_chebyshev(std::map<std::string, std::string>
         filter_option, int &nCoefficients, f_vector_t &b, f_vector_t &a)
 {
-    python::import();
-    auto pFunc = python::import("utilities", "beam_profile_filter_chebyshev");
-    auto pNMacroparticles = python::convert_double_array(n_macroparticles.data(),
-                            n_macroparticles.size());
-    auto pResolution = python::convert_double(bin_centers[1] - bin_centers[0]);
-    auto pNSlices = python::convert_int(n_slices);
-
     if (filter_option.find("transfer_function_plot") != filter_option.end()
             && filter_option["transfer_function_plot"] == "true") {
         std::cerr << "[beam_profile_filter_chebyshev] A complex vector must\n"
@@ -448,28 +956,12 @@ void Slices::beam_profile_filter_chebyshev(std::map<std::string, std::string>
                   << "function with transfer_function_plot ==true\n";
         exit(-1);
     }
+    filter_option.erase("transfer_function_plot");
 
-    auto pFilterOption = python::convert_dictionary(filter_option);
-
-    auto ret = PyObject_CallFunctionObjArgs(pFunc, pNMacroparticles,
-                                            pResolution, pNSlices,
-                                            pFilterOption, NULL);
-
-    if (!ret) {
-        std::cerr << "[beam_profile_filter_chebyshev] An error occured "
-                  << "while running a python function\n";
-        exit(-1);
-    }
-
-    auto npArray = (PyArrayObject *) ret;
-    int len = PyArray_SHAPE(npArray)[0];
-    double *res = (double *) PyArray_DATA(npArray);
-
-    nCoefficients = res[0];
-    assert(len == 3 + 2 * nCoefficients);
-
-    b = f_vector_t(&res[1], &res[1 + 1 + nCoefficients]);
-    a = f_vector_t(&res[2 + nCoefficients], &res[3 + 2 * nCoefficients]);
+    const auto &filter = chebyshev_filter(filter_option);
+    nCoefficients = filter.order;
+    b = filter.b;
+    a = filter.a;
 }
 
 // NOTE
@@ -479,13 +971,6 @@ void Slices::beam_profile_filter_chebyshev(std::map<std::string, std::string>
         filter_option, int &nCoefficients,
         f_vector_t &transferFreq, complex_vector_t &transferGain)
 {
-    python::import();
-    auto pFunc = python::import("utilities", "beam_profile_filter_chebyshev");
-    auto pNMacroparticles = python::convert_double_array(n_macroparticles.data(),
-                            n_macroparticles.size());
-    auto pResolution = python::convert_double(bin_centers[1] - bin_centers[0]);
-    auto pNSlices = python::convert_int(n_slices);
-
     if (filter_option.find("transfer_function_plot") == filter_option.end()
             || filter_option["transfer_function_plot"] != "true") {
         std::cerr << "[beam_profile_filter_chebyshev] A double vector must\n"
@@ -493,69 +978,57 @@ void Slices::beam_profile_filter_chebyshev(std::map<std::string, std::string>
                   << "function without transfer_function_plot == true\n";
         exit(-1);
     }
-    auto pFilterOption = python::convert_dictionary(filter_option);
-
-    auto ret = PyObject_CallFunctionObjArgs(pFunc, pNMacroparticles,
-                                            pResolution, pNSlices,
-                                            pFilterOption, NULL);
+    filter_option.erase("transfer_function_plot");
 
-    if (!ret) {
-        std::cerr << "[beam_profile_filter_chebyshev] An error occured "
-                  << "while running a python function\n";
-        exit(-1);
-    }
+    const auto &filter = chebyshev_filter(filter_option);
+    nCoefficients = filter.order;
 
-    auto npArray = (PyArrayObject *) ret;
-    int len = PyArray_SHAPE(npArray)[0];
-    double *res = (double *) PyArray_DATA(npArray);
-
-    assert(len == 1 + 3 * n_slices);
-
-    nCoefficients = res[0];
-    transferFreq = f_vector_t(&res[1], &res[1 + n_slices]);
-
-    for (int i = 1 + n_slices; i < 1 + 2 * n_slices; i++) {
-        transferGain.push_back({res[i], res[i + n_slices]});
-    }
+    const double nyq_freq = 1. / (bin_centers[1] - bin_centers[0]) / 2.;
+    transferFreq.resize(n_slices);
+    transferGain.resize(n_slices);
+    mymath::freqz(filter.b, filter.a, n_slices, transferFreq.data(),
+                  transferGain.data());
+    for (auto &f : transferFreq) f *= nyq_freq / constant::pi;
 }
 
 
+// Warm started from the previous fit, the first one from the moments of
+// the profile
 void Slices::gaussian_fit()
 {
-    f_vector_t p0;
-    double max = *std::max_element(ALL(n_macroparticles));
+    const int n = n_macroparticles.size();
+    if (n == 0 || n != (int) bin_centers.size()) {
+        std::cerr << "[gaussian_fit] The profile and the bin centers "
+                  << "differ in size\n";
+        exit(-1);
+    }
+
+    double p[3];
+    p[0] = *std::max_element(ALL(n_macroparticles));
 
     if (bl_gauss == 0 && bp_gauss == 0) {
-        p0 = {max,
-              mymath::mean(beam->dt),
-              mymath::standard_deviation(beam->dt)
-             };
+        double weight = 0., mean = 0., variance = 0.;
+        for (int i = 0; i < n; i++) {
+            weight += n_macroparticles[i];
+            mean += n_macroparticles[i] * bin_centers[i];
+        }
+        mean /= weight;
+        for (int i = 0; i < n; i++)
+            variance += n_macroparticles[i] * (bin_centers[i] - mean)
+                        * (bin_centers[i] - mean);
+        p[1] = mean;
+        p[2] = std::sqrt(variance / weight);
     } else {
-        p0 = {max,
-              bp_gauss,
-              bl_gauss / 4
-             };
+        p[1] = bp_gauss;
+        p[2] = bl_gauss / 4;
     }
 
-    python::import();
-    auto pFunc = python::import("utilities", "curve_fit");
-    auto pBinCenters = python::convert_double_array(bin_centers.data(),
-                       bin_centers.size());
-    auto pNMacroparticles = python::convert_double_array(n_macroparticles.data(),
-                            n_macroparticles.size());
-    auto pP0 = python::convert_double_array(p0.data(), p0.size());
-    auto ret = PyObject_CallFunctionObjArgs(pFunc, pBinCenters,
-                                            pNMacroparticles, pP0, NULL);
-    if (!ret) {
-        std::cerr << "[gaussian_fit] An error occured while running"
-                  << "a python function\n";
+    if (!(p[0] > 0) || !mymath::gaussian_fit(bin_centers.data(),
+            n_macroparticles.data(), n, p)) {
+        std::cerr << "[gaussian_fit] The fit of the profile did not "
+                  << "converge\n";
         exit(-1);
     }
-
-    auto npArray = (PyArrayObject *) ret;
-    int len = PyArray_SHAPE(npArray)[0];
-    double *pfit_gauss = (double *) PyArray_DATA(npArray);
-    bl_gauss = 4 * std::abs(pfit_gauss[2]);
-    bp_gauss = std::abs(pfit_gauss[1]);
-
+    bl_gauss = 4 * std::abs(p[2]);
+    bp_gauss = std::abs(p[1]);
 }
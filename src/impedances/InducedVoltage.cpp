@@ -10,13 +10,16 @@
 using namespace blond;
 
 
-void blond::linear_interp_kick(
-    const double *__restrict beam_dt,
-    double *__restrict beam_dE,
+template <typename real_t>
+static inline void interp_kick(
+    const real_t *__restrict beam_dt,
+    real_t *__restrict beam_dE,
     const double *__restrict voltage_array,
     const double *__restrict bin_centers,
     const int n_slices,
-    const int n_macroparticles)
+    const int n_macroparticles,
+    const double dt_offset = 0.,
+    const double scale = 1.)
 {
 
     const double binFirst = bin_centers[0];
@@ -25,7 +28,7 @@ void blond::linear_interp_kick(
 
     #pragma omp parallel for
     for (int i = 0; i < n_macroparticles; ++i) {
-        const double a = beam_dt[i];
+        const double a = beam_dt[i] + dt_offset;
         const int ffbin = static_cast<int>((a - binFirst) * inv_bin_width);
         const double voltageKick =
             ((a < binFirst) || (a > binLast))
@@ -34,7 +37,125 @@ void blond::linear_interp_kick(
             (a - bin_centers[ffbin]) *
             (voltage_array[ffbin + 1] - voltage_array[ffbin]) *
             inv_bin_width;
-        beam_dE[i] += voltageKick;
+        beam_dE[i] += scale * voltageKick;
+    }
+}
+
+void blond::linear_interp_kick(
+    const double *__restrict beam_dt,
+    double *__restrict beam_dE,
+    const double *__restrict voltage_array,
+    const double *__restrict bin_centers,
+    const int n_slices,
+    const int n_macroparticles)
+{
+    interp_kick(beam_dt, beam_dE, voltage_array, bin_centers, n_slices,
+                n_macroparticles);
+}
+
+void blond::linear_interp_kick(
+    const float *__restrict beam_dt,
+    float *__restrict beam_dE,
+    const double *__restrict voltage_array,
+    const double *__restrict bin_centers,
+    const int n_slices,
+    const int n_macroparticles,
+    const double dt_offset)
+{
+    interp_kick(beam_dt, beam_dE, voltage_array, bin_centers, n_slices,
+                n_macroparticles, dt_offset);
+}
+
+void blond::linear_interp_kick(Beams *beam,
+                               const double *__restrict voltage_array,
+                               const double *__restrict bin_centers,
+                               const int n_slices,
+                               const double scale)
+{
+    if (beam->precision == ParticleStorage::single_precision)
+        interp_kick(beam->dt_f.data(), beam->dE_f.data(), voltage_array,
+                    bin_centers, n_slices, beam->n_macroparticles,
+                    beam->dt_reference, scale);
+    else
+        interp_kick(beam->dt.data(), beam->dE.data(), voltage_array,
+                    bin_centers, n_slices, beam->n_macroparticles, 0., scale);
+}
+
+// Kick with the voltage interpolated by the ORDER B-spline shape of
+// Slices::spline_histogram(), zero past half a bin out of the first and
+// last bin centers
+template <int ORDER, typename real_t>
+static inline void spline_interp_kick(
+    const real_t *__restrict beam_dt,
+    real_t *__restrict beam_dE,
+    const double *__restrict voltage_array,
+    const double *__restrict bin_centers,
+    const int n_slices,
+    const int n_macroparticles,
+    const double dt_offset = 0.,
+    const double scale = 1.)
+{
+
+    const double binFirst = bin_centers[0];
+    const double binLast = bin_centers[n_slices - 1];
+    const double inv_bin_width = (n_slices - 1) / (binLast - binFirst);
+    const double half_bin = 0.5 / inv_bin_width;
+
+    #pragma omp parallel for
+    for (int i = 0; i < n_macroparticles; ++i) {
+        const double a = beam_dt[i] + dt_offset;
+        if ((a < binFirst - half_bin) || (a > binLast + half_bin)) continue;
+        double w[ORDER + 1];
+        const int first = spline_weights<ORDER>((a - binFirst) * inv_bin_width,
+                                                w);
+        double voltageKick = 0.;
+        for (int b = 0; b <= ORDER; ++b) {
+            const int bin = first + b;
+            if (bin >= 0 && bin < n_slices)
+                voltageKick += w[b] * voltage_array[bin];
+        }
+        beam_dE[i] += scale * voltageKick;
+    }
+}
+
+template <int ORDER>
+static void spline_interp_kick(Beams *beam,
+                               const double *__restrict voltage_array,
+                               const double *__restrict bin_centers,
+                               const int n_slices,
+                               const double scale)
+{
+    if (beam->precision == ParticleStorage::single_precision)
+        spline_interp_kick<ORDER>(beam->dt_f.data(), beam->dE_f.data(),
+                                  voltage_array, bin_centers, n_slices,
+                                  beam->n_macroparticles, beam->dt_reference,
+                                  scale);
+    else
+        spline_interp_kick<ORDER>(beam->dt.data(), beam->dE.data(),
+                                  voltage_array, bin_centers, n_slices,
+                                  beam->n_macroparticles, 0., scale);
+}
+
+void blond::deposit_interp_kick(Beams *beam,
+                                const double *__restrict voltage_array,
+                                const Slices *slices,
+                                const double scale)
+{
+    switch (slices->deposit) {
+        case Slices::tsc:
+            spline_interp_kick<2>(beam, voltage_array,
+                                  slices->bin_centers.data(), slices->n_slices,
+                                  scale);
+            break;
+        case Slices::cubic:
+            spline_interp_kick<3>(beam, voltage_array,
+                                  slices->bin_centers.data(), slices->n_slices,
+                                  scale);
+            break;
+        default:
+            linear_interp_kick(beam, voltage_array, slices->bin_centers.data(),
+                               slices->n_slices, scale);
+            break;
     }
 }
 
@@ -61,22 +182,70 @@ InducedVoltageTime::InducedVoltageTime(Slices *slices,
     fTimeArray = fSlices->bin_centers - fSlices->bin_centers[0];
     sum_wakes(fTimeArray);
 
-    fCut = fTimeArray.size() + fSlices->n_slices - 1;
-    fShape = mymath::next_regular(fCut);
+    fConvN = 0;
+    prepare_convolution();
 
     fTimeOrFreq = TimeOrFreq;
+    fFrameSlices = fSlices->n_slices;
+    fWakeCache[fFrameSlices] = fTotalWake;
 }
 
-InducedVoltageTime::~InducedVoltageTime() { fft::destroy_plans(); }
+InducedVoltageTime::~InducedVoltageTime()
+{
+    fft::destroy_plans();
+}
 
 inline void InducedVoltageTime::track(Beams *beam)
 {
     // Tracking Method
-    f_vector_t v = this->induced_voltage_generation(beam) * beam->charge;
+    induced_voltage_generation(beam);
+    deposit_interp_kick(beam, fInducedVoltage.data(), fSlices, beam->charge);
+}
+
+void InducedVoltageTime::prepare_convolution()
+{
+    fCut = fTimeArray.size() + fSlices->n_slices - 1;
+    fShape = mymath::next_regular(fCut);
+    fWakeSpectrum.clear();
+}
+
+void InducedVoltageTime::plan_convolution()
+{
+    if (!fForwardPlan || fShape != fConvN) {
+        fConvInput.resize(fShape);
+        fConvSpectrum.resize(fShape / 2 + 1);
+        fConvOutput.resize(fShape);
+        // The forward plan keeps its input, so the zero padding past the
+        // profile is only written here
+        fForwardPlan = fft::init_rfft(fShape, fConvInput.data(),
+                                      fConvSpectrum.data(), FFTW_ESTIMATE,
+                                      Context::n_threads);
+        fBackwardPlan = fft::init_irfft(fShape, fConvSpectrum.data(),
+                                        fConvOutput.data(), fft::FFTW_FLAGS,
+                                        Context::n_threads);
+        fConvN = fShape;
+    }
+
+    std::fill(fConvInput.begin(), fConvInput.end(), 0.0);
+    std::copy(fTotalWake.begin(), fTotalWake.end(), fConvInput.begin());
+    fft::run_fft(fForwardPlan);
+    fWakeSpectrum.assign(fConvSpectrum.begin(), fConvSpectrum.end());
+    std::fill(fConvInput.begin(), fConvInput.end(), 0.0);
+}
+
+bool InducedVoltageTime::use_fft(const int nOut) const
+{
+    if (fTimeOrFreq != automatic)
+        return fTimeOrFreq == freq_domain;
+
+    // Products of the direct convolution of the first nOut points
+    const int m = fTotalWake.size();
+    const int n = fSlices->n_slices;
+    double direct = 0;
+    for (int k = 0; k < nOut; ++k)
+        direct += std::min(k, m - 1) - std::max(0, k - n + 1) + 1;
 
-    linear_interp_kick(beam->dt.data(), beam->dE.data(), v.data(),
-                       fSlices->bin_centers.data(), fSlices->n_slices,
-                       beam->n_macroparticles);
+    return direct > CONVOLUTION_FFT_COST * fShape * std::log2(fShape);
 }
 
 void InducedVoltageTime::sum_wakes(f_vector_t &TimeArray)
@@ -100,9 +269,27 @@ void InducedVoltageTime::reprocess(Slices *newSlices)
     // fTimeArray.resize(fSlices->n_slices);
     fTimeArray = fSlices->bin_centers - fSlices->bin_centers[0];
     sum_wakes(fTimeArray);
+    prepare_convolution();
 
-    fCut = fTimeArray.size() + fSlices->n_slices - 1;
-    fShape = mymath::next_regular(fCut);
+    fFrameSlices = fSlices->n_slices;
+    fWakeCache.clear();
+    fWakeCache[fFrameSlices] = fTotalWake;
+}
+
+void InducedVoltageTime::update_frame()
+{
+    fFrameSlices = fSlices->n_slices;
+    fTimeArray = fSlices->bin_centers - fSlices->bin_centers[0];
+
+    auto it = fWakeCache.find(fFrameSlices);
+    if (it == fWakeCache.end()) {
+        sum_wakes(fTimeArray);
+        fWakeCache[fFrameSlices] = fTotalWake;
+    } else {
+        fTotalWake = it->second;
+    }
+
+    prepare_convolution();
 }
 
 f_vector_t InducedVoltageTime::induced_voltage_generation(Beams *beam,
@@ -110,40 +297,71 @@ f_vector_t InducedVoltageTime::induced_voltage_generation(Beams *beam,
 {
 
     // Method to calculate the induced voltage from wakes with convolution.*
-    f_vector_t inducedVoltage;
 
-    const double factor = -beam->charge * constant::e * beam->intensity
-                          / beam->n_macroparticles;
+    if (fSlices->n_slices != fFrameSlices)
+        update_frame();
 
-    if (fTimeOrFreq == freq_domain) {
-        auto in1 = fSlices->n_macroparticles;
-        auto in2 = fTotalWake;
-
-        fft::convolution_with_ffts(in1, in2, inducedVoltage);
-        inducedVoltage *= factor;
+    if (fTimeOrFreq != time_domain && fTimeOrFreq != freq_domain
+            && fTimeOrFreq != automatic) {
+        std::cerr << "Error: Only freq_domain, time_domain or automatic "
+                  << "are allowed\n";
+        exit(-1);
+    }
 
-    } else if (fTimeOrFreq == time_domain) {
+    const double factor = -beam->charge * constant::e * beam->intensity
+                          / beam->n_macroparticles;
 
-        inducedVoltage.resize(fTotalWake.size() + fSlices->n_slices - 1);
+    // Only the points that are kept, of the fCut of the linear convolution
+    const int nOut = std::min(std::max(fSlices->n_slices, length), fCut);
+    const double *res;
+    double scale;
+
+    if (use_fft(nOut)) {
+        if (fWakeSpectrum.empty() || !fForwardPlan)
+            plan_convolution();
+
+        std::copy(fSlices->n_macroparticles.begin(),
+                  fSlices->n_macroparticles.end(), fConvInput.begin());
+        fft::run_fft(fForwardPlan);
+
+        double *__restrict spectrum =
+            reinterpret_cast<double *>(fConvSpectrum.data());
+        const double *__restrict wake =
+            reinterpret_cast<const double *>(fWakeSpectrum.data());
+        const int m = fWakeSpectrum.size();
+        for (int j = 0; j < m; ++j) {
+            const double sr = spectrum[2 * j], si = spectrum[2 * j + 1];
+            const double wr = wake[2 * j], wi = wake[2 * j + 1];
+            spectrum[2 * j] = sr * wr - si * wi;
+            spectrum[2 * j + 1] = sr * wi + si * wr;
+        }
 
+        fft::run_fft(fBackwardPlan);
+        res = fConvOutput.data();
+        // The inverse transform is not normalised
+        scale = factor / fConvN;
+    } else {
+        fConvVoltage.resize(nOut);
         mymath::convolution(fTotalWake.data(), fTotalWake.size(),
                             fSlices->n_macroparticles.data(),
                             fSlices->n_macroparticles.size(),
-                            inducedVoltage.data());
-        inducedVoltage *= factor;
-
-    } else {
-        std::cerr << "Error: Only freq_domain or time_domain are allowed\n";
-        exit(-1);
+                            fConvVoltage.data(), nOut);
+        res = fConvVoltage.data();
+        scale = factor;
     }
 
-    fInducedVoltage = inducedVoltage;
     fInducedVoltage.resize(fSlices->n_slices);
+    for (int j = 0; j < fSlices->n_slices; ++j)
+        fInducedVoltage[j] = scale * res[j];
+
+    if (length > 0) {
+        f_vector_t inducedVoltage(length, 0);
+        for (int j = 0; j < std::min(length, nOut); ++j)
+            inducedVoltage[j] = scale * res[j];
+        return inducedVoltage;
+    }
 
-    if (length > 0)
-        inducedVoltage.resize(length, 0);
-
-    return inducedVoltage;
+    return f_vector_t();
 }
 
 InducedVoltageFreq::InducedVoltageFreq(Slices *slices,
@@ -157,6 +375,7 @@ InducedVoltageFreq::InducedVoltageFreq(Slices *slices,
     fNTurnsMem = NTurnsMem;
     fSlices = slices;
     fImpedanceSourceList = impedList;
+    fVoltageN = fVoltageRows = 0;
     fFreqResolutionInput = freqResolutionInput;
 
     // *Length of one slice.*
@@ -208,24 +427,18 @@ InducedVoltageFreq::InducedVoltageFreq(Slices *slices,
         sum_impedances(fFreqArray);
 
         fSaveIndividualVoltages = saveIndividualVoltages;
-        if (fSaveIndividualVoltages) {
-            // Do I really need to store the length??
-            int length = fImpedanceSourceList.size();
-            fMatrixSaveIndividualImpedances =
-                complex_vector_t(length * fFreqArray.size(), 0);
-            fMatrixSaveIndividualVoltages =
-                f_vector_t(length * fSlices->n_slices, 0);
-            for (int i = 0; i < length; ++i) {
-                const int row_width =
-                    fImpedanceSourceList[i]->fImpedance.size();
-                for (int j = 0; j < row_width; ++j) {
-                    fMatrixSaveIndividualImpedances[i * row_width + j] =
-                        fImpedanceSourceList[i]->fImpedance[j];
-                }
-            }
-        }
+        if (fSaveIndividualVoltages)
+            save_individual_impedances();
+
+        fFrameSlices = fSlices->n_slices;
+        fFrameCache[fFrameSlices] = {fNFFTSampling, fFreqResolution,
+                                     fFreqArray, fTotalImpedance,
+                                     fMatrixSaveIndividualImpedances
+                                    };
 
     } else {
+        fSaveIndividualVoltages = saveIndividualVoltages;
+        fFrameSlices = fSlices->n_slices;
         fNTurnsMem = NTurnsMem;
         fLenArrayMem = (fNTurnsMem + 1) * fSlices->n_slices;
         fLenArrayMemExt = (fNTurnsMem + 2) * fSlices->n_slices;
@@ -250,18 +463,68 @@ InducedVoltageFreq::InducedVoltageFreq(Slices *slices,
     }
 }
 
-InducedVoltageFreq::~InducedVoltageFreq() { fft::destroy_plans(); }
+InducedVoltageFreq::~InducedVoltageFreq()
+{
+    fft::destroy_plans();
+}
+
+void InducedVoltageFreq::save_individual_impedances()
+{
+    const int length = fImpedanceSourceList.size();
+    const int m = fFreqArray.size();
+    fMatrixSaveIndividualImpedances.assign(length * m, complex_t(0, 0));
+    fMatrixSaveIndividualVoltages.assign(length * fSlices->n_slices, 0);
+
+    #pragma omp parallel for
+    for (int i = 0; i < length; ++i) {
+        const auto &impedance = fImpedanceSourceList[i]->fImpedance;
+        const int row_width = std::min(m, (int) impedance.size());
+        std::copy(impedance.begin(), impedance.begin() + row_width,
+                  fMatrixSaveIndividualImpedances.begin() + i * m);
+    }
+}
 
 void InducedVoltageFreq::track(Beams *beam)
 {
     // Tracking Method
 
     induced_voltage_generation(beam);
-    auto v = fInducedVoltage * beam->charge;
+    deposit_interp_kick(beam, fInducedVoltage.data(), fSlices, beam->charge);
+}
+
+void InducedVoltageFreq::impedance_voltage(const complex_t *impedance,
+        const int rows)
+{
+    const int m = fSlices->fBeamSpectrum.size();
+    const int n = 2 * (m - 1);
+    if (!fVoltagePlan || n != fVoltageN || rows != fVoltageRows) {
+        fVoltageSpectrum.resize(rows * m);
+        fVoltageOutput.resize(rows * n);
+        fVoltagePlan = fft::init_irfft_many(n, rows, fVoltageSpectrum.data(),
+                                            fVoltageOutput.data(),
+                                            fft::FFTW_FLAGS,
+                                            Context::n_threads);
+        fVoltageN = n;
+        fVoltageRows = rows;
+    }
 
-    linear_interp_kick(beam->dt.data(), beam->dE.data(), v.data(),
-                       fSlices->bin_centers.data(), fSlices->n_slices,
-                       beam->n_macroparticles);
+    // Complex product on the interleaved real and imaginary parts
+    const double *__restrict z = reinterpret_cast<const double *>(impedance);
+    const double *__restrict b =
+        reinterpret_cast<const double *>(fSlices->fBeamSpectrum.data());
+    double *__restrict out = reinterpret_cast<double *>(fVoltageSpectrum.data());
+    #pragma omp parallel for if (rows > 1)
+    for (int i = 0; i < rows; ++i) {
+        const int row = 2 * i * m;
+        for (int j = 0; j < m; ++j) {
+            const double zr = z[row + 2 * j], zi = z[row + 2 * j + 1];
+            const double br = b[2 * j], bi = b[2 * j + 1];
+            out[row + 2 * j] = zr * br - zi * bi;
+            out[row + 2 * j + 1] = zr * bi + zi * br;
+        }
+    }
+
+    fft::run_fft(fVoltagePlan);
 }
 
 void InducedVoltageFreq::sum_impedances(f_vector_t &freq_array)
@@ -278,7 +541,33 @@ void InducedVoltageFreq::sum_impedances(f_vector_t &freq_array)
 void InducedVoltageFreq::reprocess(Slices *newSlices)
 {
     fSlices = newSlices;
+    fFrameCache.clear();
+    process_frame();
+}
+
+void InducedVoltageFreq::update_frame()
+{
+    auto it = fFrameCache.find(fSlices->n_slices);
+    if (it == fFrameCache.end()) {
+        process_frame();
+        return;
+    }
+
+    const auto &tables = it->second;
+    fFrameSlices = fSlices->n_slices;
+    fNFFTSampling = tables.n_fft_sampling;
+    fFreqResolution = tables.freq_resolution;
+    fFreqArray = tables.freq_array;
+    fTotalImpedance = tables.total_impedance;
+    if (fSaveIndividualVoltages) {
+        fMatrixSaveIndividualImpedances = tables.individual_impedances;
+        fMatrixSaveIndividualVoltages.assign(
+            fImpedanceSourceList.size() * fSlices->n_slices, 0);
+    }
+}
 
+void InducedVoltageFreq::process_frame()
+{
     auto timeResolution = (fSlices->bin_centers[1] - fSlices->bin_centers[0]);
     if (fFreqResolutionInput == 0) {
         fNFFTSampling = fSlices->n_slices;
@@ -322,6 +611,14 @@ void InducedVoltageFreq::reprocess(Slices *newSlices)
 
     fTotalImpedance.clear();
     sum_impedances(fFreqArray);
+    if (fSaveIndividualVoltages)
+        save_individual_impedances();
+
+    fFrameSlices = fSlices->n_slices;
+    fFrameCache[fFrameSlices] = {fNFFTSampling, fFreqResolution, fFreqArray,
+                                 fTotalImpedance,
+                                 fMatrixSaveIndividualImpedances
+                                };
 }
 
 f_vector_t InducedVoltageFreq::induced_voltage_generation(Beams *beam,
@@ -330,8 +627,14 @@ f_vector_t InducedVoltageFreq::induced_voltage_generation(Beams *beam,
     //    Method to calculate the induced voltage from the inverse FFT of the
     //    impedance times the spectrum (fourier convolution).
 
-    if (fRecalculationImpedance)
+    if (fSlices->n_slices != fFrameSlices)
+        update_frame();
+
+    if (fRecalculationImpedance) {
         sum_impedances(fFreqArray);
+        if (fSaveIndividualVoltages)
+            save_individual_impedances();
+    }
 
     fSlices->beam_spectrum_generation(fNFFTSampling);
     const int n = fImpedanceSourceList.size();
@@ -339,65 +642,51 @@ f_vector_t InducedVoltageFreq::induced_voltage_generation(Beams *beam,
                         fSlices->fBeamSpectrumFreq[1] * 2 *
                         (fSlices->fBeamSpectrum.size() - 1);
 
-    if (fSaveIndividualVoltages) {
-
-        for (int i = 0; i < n; ++i) {
-            f_vector_t res;
-            complex_vector_t in(fSlices->fBeamSpectrum.size());
+    // irfft divides by its size
+    const double scale = factor / (2 * (fSlices->fBeamSpectrum.size() - 1));
 
-            for (uint j = 0; j < in.size(); ++j) {
-                in[j] = fMatrixSaveIndividualImpedances[j * n + i] *
-                        fSlices->fBeamSpectrum[j];
-            }
-
-            fft::irfft(in, res, 0, Context::n_threads);
-
-            assert((int)res.size() >= fSlices->n_slices);
+    const int nSlices = fSlices->n_slices;
 
-            res.resize(fSlices->n_slices);
-            res *= factor;
-
-            for (int j = 0; j < fSlices->n_slices; ++j) {
-                fMatrixSaveIndividualVoltages[j * n + i] = res[j];
-            }
-        }
-
-        fInducedVoltage.clear();
-        fInducedVoltage.resize(fSlices->fBeamSpectrum.size());
-        for (uint i = 0; i < fSlices->fBeamSpectrum.size(); ++i) {
+    if (fSaveIndividualVoltages) {
+        // All the sources in one batched transform
+        impedance_voltage(fMatrixSaveIndividualImpedances.data(), n);
+        assert(fVoltageN >= nSlices);
+
+        fMatrixSaveIndividualVoltages.resize(n * nSlices);
+        const double *__restrict out = fVoltageOutput.data();
+        double *__restrict voltages = fMatrixSaveIndividualVoltages.data();
+        const int outWidth = fVoltageN;
+
+        #pragma omp parallel for
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < nSlices; ++j)
+                voltages[i * nSlices + j] = scale * out[i * outWidth + j];
+
+        fInducedVoltage.resize(nSlices);
+        #pragma omp parallel for
+        for (int j = 0; j < nSlices; ++j) {
             double sum = 0.0;
-            for (int j = 0; j < n; ++j) {
-                sum += fMatrixSaveIndividualVoltages[i * n + j];
-            }
-            fInducedVoltage[i] = sum;
+            for (int i = 0; i < n; ++i)
+                sum += voltages[i * nSlices + j];
+            fInducedVoltage[j] = sum;
         }
-
-        return f_vector_t();
-
     } else {
-        f_vector_t res;
-        complex_vector_t in(fSlices->fBeamSpectrum.size());
-        for (uint j = 0; j < in.size(); ++j) {
-            in[j] = fTotalImpedance[j] * fSlices->fBeamSpectrum[j];
-        }
-
-        fft::irfft(in, res, 0, Context::n_threads);
-        assert((int)res.size() >= fSlices->n_slices);
-
-        res.resize(fSlices->n_slices);
-        res *= factor;
-
-        fInducedVoltage = res;
+        impedance_voltage(fTotalImpedance.data(), 1);
+        assert(fVoltageN >= nSlices);
 
-        if (length > 0) {
-            if (length > (int)res.size())
-                res.resize(length, 0);
-            else
-                res.resize(length);
-        }
+        // Scaled on the way out of the plan buffer
+        fInducedVoltage.resize(nSlices);
+        for (int j = 0; j < nSlices; ++j)
+            fInducedVoltage[j] = scale * fVoltageOutput[j];
+    }
 
+    if (length > 0) {
+        f_vector_t res(fInducedVoltage);
+        res.resize(length, 0);
         return res;
     }
+
+    return f_vector_t();
 }
 
 TotalInducedVoltage::TotalInducedVoltage(Beams *beam, Slices *slices,
@@ -409,26 +698,137 @@ TotalInducedVoltage::TotalInducedVoltage(Beams *beam, Slices *slices,
     fSlices = slices;
     fInducedVoltageList = InducedVoltageList;
     fNTurnsMemory = NTurnsMemory;
+    fRevTimeArray = RevTimeArray;
     fInducedVoltage = f_vector_t();
     fTimeArray = fSlices->bin_centers;
+    fLenArrayMem = fNPointsFFT = 0;
+    fMemoryRevTime = 0.;
+
+    if (fNTurnsMemory > 0) {
+        if (fSlices->adaptive_frame) {
+            std::cerr << "[TotalInducedVoltage] The multi-turn memory "
+                      << "needs a fixed frame, not an adaptive one\n";
+            exit(-1);
+        }
+        // The memory window and frequencies of the first source, the
+        // impedances of all of them
+        for (const auto &v : fInducedVoltageList) {
+            auto freq = dynamic_cast<InducedVoltageFreq *>(v);
+            if (!freq || freq->fNTurnsMem != fNTurnsMemory) {
+                std::cerr << "[TotalInducedVoltage] The multi-turn memory "
+                          << "needs InducedVoltageFreq sources with "
+                          << fNTurnsMemory << " turns of memory\n";
+                exit(-1);
+            }
+            if (fSumImpedancesMemory.empty()) {
+                fLenArrayMem = freq->fLenArrayMem;
+                fNPointsFFT = freq->fNPointsFFT;
+                fFreqArrayMem = freq->fFreqArrayMem;
+                fSumImpedancesMemory = freq->fTotalImpedanceMem;
+            } else {
+                fSumImpedancesMemory += freq->fTotalImpedanceMem;
+            }
+        }
+        if (fRevTimeArray.empty()) {
+            std::cerr << "[TotalInducedVoltage] The multi-turn memory "
+                      << "needs the revolution time of every turn\n";
+            exit(-1);
+        }
+        fArrayMemory.assign(fFreqArrayMem.size(), complex_t(0., 0.));
+
+        fMemoryReal.assign(fNPointsFFT, 0.);
+        fMemorySpectrum.assign(fFreqArrayMem.size(), complex_t(0., 0.));
+    }
+}
+
+TotalInducedVoltage::~TotalInducedVoltage()
+{
+    fft::destroy_plans();
 }
 
-TotalInducedVoltage::~TotalInducedVoltage() { fft::destroy_plans(); }
+void TotalInducedVoltage::plan_memory()
+{
+    fMemoryForward = fft::init_rfft(fNPointsFFT, fMemoryReal.data(),
+                                    fMemorySpectrum.data(), fft::FFTW_FLAGS,
+                                    Context::n_threads);
+    fMemoryBackward = fft::init_irfft(fNPointsFFT, fMemorySpectrum.data(),
+                                      fMemoryReal.data(), fft::FFTW_FLAGS,
+                                      Context::n_threads);
+}
 
 void TotalInducedVoltage::track(Beams *beam)
 {
+    if (fNTurnsMemory > 0) {
+        track_memory(beam);
+        return;
+    }
 
     this->induced_voltage_sum(beam);
-    auto v = this->fInducedVoltage * beam->charge;
-
-    linear_interp_kick(beam->dt.data(), beam->dE.data(), v.data(),
-                       fSlices->bin_centers.data(), fSlices->n_slices,
-                       beam->n_macroparticles);
+    deposit_interp_kick(beam, fInducedVoltage.data(), fSlices, beam->charge);
 }
 
-void TotalInducedVoltage::track_memory() {}
+void TotalInducedVoltage::track_memory(Beams *beam)
+{
+    if (fCounterTurn >= (int) fRevTimeArray.size()) {
+        std::cerr << "[TotalInducedVoltage] No revolution time for turn "
+                  << fCounterTurn << "\n";
+        exit(-1);
+    }
+    if (fSlices->adaptive_frame) {
+        std::cerr << "[TotalInducedVoltage] The multi-turn memory "
+                  << "needs a fixed frame, not an adaptive one\n";
+        exit(-1);
+    }
+
+    // The past turns one revolution further back
+    const double revTime = fRevTimeArray[fCounterTurn];
+    const int n = fArrayMemory.size();
+    if (revTime != fMemoryRevTime || (int) fMemoryPhase.size() != n) {
+        fMemoryPhase.resize(n);
+        for (int i = 0; i < n; ++i)
+            fMemoryPhase[i] = std::polar(1., 2 * constant::pi
+                                         * fFreqArrayMem[i] * revTime);
+        fMemoryRevTime = revTime;
+    }
+
+    if (!fMemoryForward) plan_memory();
+
+    // Plus the voltage of this turn, normalised for the inverse transform
+    const int nSlices = fSlices->n_slices;
+    std::copy(fSlices->n_macroparticles.begin(),
+              fSlices->n_macroparticles.end(), fMemoryReal.begin());
+    std::fill(fMemoryReal.begin() + nSlices, fMemoryReal.end(), 0.);
+    fft::run_fft(fMemoryForward);
+    const double inv_n = 1. / fNPointsFFT;
+    for (int i = 0; i < n; ++i)
+        fMemorySpectrum[i] = (fArrayMemory[i] * fMemoryPhase[i]
+                              + fMemorySpectrum[i] * fSumImpedancesMemory[i])
+                             * inv_n;
+    fft::run_fft(fMemoryBackward);
+
+    const double coefficient = -beam->charge * constant::e * beam->ratio
+                               / (fSlices->bin_centers[1]
+                                  - fSlices->bin_centers[0]);
+    fInducedVoltage.resize(nSlices);
+    for (int i = 0; i < nSlices; ++i)
+        fInducedVoltage[i] = coefficient * fMemoryReal[i];
+
+    // What is left past the memory window is dropped
+    std::fill(fMemoryReal.begin() + fLenArrayMem, fMemoryReal.end(), 0.);
+    fft::run_fft(fMemoryForward);
+    std::copy(fMemorySpectrum.begin(), fMemorySpectrum.end(),
+              fArrayMemory.begin());
+
+    deposit_interp_kick(beam, fInducedVoltage.data(), fSlices, beam->charge);
+
+    fCounterTurn++;
+}
 
-void TotalInducedVoltage::track_ghosts_particles(Beams *ghostBeam) {}
+void TotalInducedVoltage::track_ghosts_particles(Beams *ghostBeam)
+{
+    deposit_interp_kick(ghostBeam, fInducedVoltage.data(), fSlices,
+                        ghostBeam->charge);
+}
 
 void TotalInducedVoltage::reprocess(Slices *newSlices)
 {
@@ -441,8 +841,9 @@ void TotalInducedVoltage::reprocess(Slices *newSlices)
 f_vector_t TotalInducedVoltage::induced_voltage_sum(Beams *beam, int length)
 {
     // Method to sum all the induced voltages in one single array.
-    f_vector_t tempIndVolt;
+    // Summed in place, clear() keeps the storage of the previous turn
     f_vector_t extIndVolt;
+    fInducedVoltage.clear();
 
     for (auto &v : fInducedVoltageList) {
         auto a = v->induced_voltage_generation(beam, length);
@@ -451,10 +852,9 @@ f_vector_t TotalInducedVoltage::induced_voltage_sum(Beams *beam, int length)
             extIndVolt.resize(a.size(), 0);
             extIndVolt += a;
         }
-        tempIndVolt.resize(v->fInducedVoltage.size(), 0);
-        tempIndVolt += v->fInducedVoltage;
+        fInducedVoltage.resize(v->fInducedVoltage.size(), 0);
+        fInducedVoltage += v->fInducedVoltage;
     }
 
-    fInducedVoltage = tempIndVolt;
     return extIndVolt;
 }
@@ -55,16 +55,40 @@ void Resonators::imped_calc(const f_vector_t &NewFrequencyArray)
     */
 
     fFreqArray = NewFrequencyArray;
-    fImpedance.resize(fFreqArray.size());
-    std::fill_n(fImpedance.begin(), fImpedance.size(), complex_t(0, 0));
+    const int n = fFreqArray.size();
+    const int r = fNResonators;
+    fImpedance.resize(n);
+    if (n == 0) return;
+    fImpedance[0] = complex_t(0, 0);
+
+    // R / (1 + jX) = R (1 - jX) / (1 + X^2), with
+    // X = Q (f / fR - fR / f) = f Q / fR - Q fR / f
+    f_vector_t qOverFr(r), qFr(r);
+    for (int i = 0; i < r; ++i) {
+        qOverFr[i] = fQ[i] / fFrequencyR[i];
+        qFr[i] = fQ[i] * fFrequencyR[i];
+    }
 
-    for (uint i = 0; i < fNResonators; ++i) {
-        for (uint j = 1; j < fImpedance.size(); ++j) {
-            fImpedance[j] +=
-                complex_t(fRS[i], 0) /
-                complex_t(1, fQ[i] * (fFreqArray[j] / fFrequencyR[i] -
-                                      fFrequencyR[i] / fFreqArray[j]));
+    const double *__restrict rs = fRS.data();
+    const double *__restrict a = qOverFr.data();
+    const double *__restrict b = qFr.data();
+    const double *__restrict freq = fFreqArray.data();
+    double *__restrict z = reinterpret_cast<double *>(fImpedance.data());
+
+    // All the resonators of a frequency in one vectorised pass
+    #pragma omp parallel for
+    for (int j = 1; j < n; ++j) {
+        const double f = freq[j];
+        const double inv_f = 1. / f;
+        double re = 0., im = 0.;
+        for (int i = 0; i < r; ++i) {
+            const double x = f * a[i] - b[i] * inv_f;
+            const double d = rs[i] / (1. + x * x);
+            re += d;
+            im -= d * x;
         }
+        z[2 * j] = re;
+        z[2 * j + 1] = im;
     }
 }
 
@@ -8,11 +8,6 @@
 #include <blond/vector_math.h>
 #include <blond/constants.h>
 #include <blond/math_functions.h>
-#ifdef PARALLEL
-#include <parallel/algorithm>
-#else
-#include <algorithm>
-#endif
 
 using namespace blond;
 using namespace std;
@@ -40,35 +35,15 @@ Music::Music(Beams *beam, const f_vector_t &resonator,
 
 void Music::track()
 {
-
-    struct particle {
-        double de;
-        double dt;
-        bool operator<(const particle &o) const
-        {
-            return dt < o.dt;
-        }
-    };
+    Beam->require_double_precision("Music::track");
 
 //     std::chrono::time_point<std::chrono::high_resolution_clock>start;
 //     std::chrono::duration<double> duration(0.0);
 //     start = std::chrono::system_clock::now();
 
-    vector<particle> particles;
-    particles.resize(n_macroparticles);
-    for (int i = 0; i < n_macroparticles; i++)
-        particles[i] = {Beam->dE[i], Beam->dt[i]};
-
-#ifdef PARALLEL
-    __gnu_parallel::sort(ALL(particles));
-#else
-    std::sort(ALL(particles));
-#endif
-
-    for (int i = 0; i < n_macroparticles; i++) {
-        Beam->dE[i] = particles[i].de;
-        Beam->dt[i] = particles[i].dt;
-    }
+    // The beam keeps its order from the previous turn, so this only
+    // fixes up the particles that moved past their neighbours
+    Beam->sort_by_dt();
 
 //     duration = std::chrono::system_clock::now() - start;
 //     std::cout << "sorting time: " << duration.count() << '\n';
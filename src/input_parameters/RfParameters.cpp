@@ -73,7 +73,7 @@ f_vector_t RfParameters::calc_phi_s(RfParameters *rfp,
         f_vector_t acceleration_ratio(n_turns + 1);
         for (int i = 0; i < n_turns + 1; ++i)
             acceleration_ratio[i] =
-                denergy[i] / (rfp->charge * rfp->voltage[rfp->section_index][i]);
+                denergy[i] / (rfp->charge * rfp->voltage[0][i]);
 
         for (int i = 0; i < n_turns + 1; ++i)
             if (acceleration_ratio[i] > 1 || acceleration_ratio[i] < -1)
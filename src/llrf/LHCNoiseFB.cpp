@@ -156,6 +156,18 @@ void LHCNoiseFB::fwhm_multi_bunch() {
     auto Slice = Context::Slice;
     auto RfP = Context::RfP;
 
+    // Slices in multi-bunch mode with the same pattern has the profile of
+    // every bunch already
+    if (Slice->n_bunches() == (int) fBunchPattern.size()
+            && std::equal(ALL(fBunchPattern), Slice->bunch_pattern.begin())) {
+        Slice->fwhm_multibunch();
+        for (uint i = 0; i < fBunchPattern.size(); ++i)
+            if (!std::isnan(Slice->bl_fwhm_bbb[i]))
+                fBlMeasBBB[i] = Slice->bl_fwhm_bbb[i];
+        fBlMeas = mymath::mean(fBlMeasBBB.data(), fBlMeasBBB.size());
+        return;
+    }
+
     // Find correct RF buckets
     auto phi_rf = RfP->phi_rf[0][RfP->counter];
     auto omega_rf = RfP->omega_rf[0][RfP->counter];
@@ -8,6 +8,8 @@
 #include <blond/constants.h>
 #include <blond/llrf/PhaseLoop.h>
 #include <blond/math_functions.h>
+#include <blond/openmp.h>
+#include <algorithm>
 using namespace blond;
 
 PhaseLoop::PhaseLoop(f_vector_t PL_gain, double window_coefficient, uint _delay,
@@ -32,36 +34,47 @@ void PhaseLoop::beam_phase()
     double phi_rf = RfP->phi_rf[RfP->section_index][RfP->counter];
     // Convolve with window function
     //
-    double *base = new double[Slice->n_slices];
-    double *array = new double[Slice->n_slices];
-
-    #pragma omp parallel for
-    for (int i = 0; i < (int)Slice->n_slices; ++i) {
-        const double a = alpha * Slice->bin_centers[i];
-        base[i] = std::exp(a) * Slice->n_macroparticles[i];
+    const int n_slices = Slice->n_slices;
+    window.resize(n_slices);
+    window_sin.resize(n_slices);
+    window_cos.resize(n_slices);
+    double *__restrict base = window.data();
+    double *__restrict sin_a = window_sin.data();
+    double *__restrict cos_a = window_cos.data();
+    const double *__restrict bin_centers = Slice->bin_centers.data();
+    const double *__restrict profile = Slice->n_macroparticles.data();
+
+    // Each thread runs the vector kernels on its own chunk of slices
+    #pragma omp parallel
+    {
+        const int id = omp_get_thread_num();
+        const int threads = omp_get_num_threads();
+        const int chunk = (n_slices + threads - 1) / threads;
+        const int start = std::min(id * chunk, n_slices);
+        const int end = std::min(start + chunk, n_slices);
+
+        for (int i = start; i < end; ++i) {
+            base[i] = alpha * bin_centers[i];
+            sin_a[i] = omega_rf * bin_centers[i] + phi_rf;
+        }
+        if (end > start) {
+            mymath::fast_exp_v(&base[start], &base[start], end - start);
+            mymath::fast_sincos_v(&sin_a[start], &sin_a[start],
+                                  &cos_a[start], end - start);
+        }
+        for (int i = start; i < end; ++i) {
+            base[i] *= profile[i];
+            sin_a[i] *= base[i];
+            cos_a[i] *= base[i];
+        }
     }
 
-    #pragma omp parallel for
-    for (int i = 0; i < (int)Slice->n_slices; ++i) {
-        const double a = omega_rf * Slice->bin_centers[i] + phi_rf;
-        array[i] = base[i] * std::sin(a);
-    }
     double scoeff =
-        mymath::trapezoid(array, Slice->bin_centers.data(), Slice->n_slices);
-
-    #pragma omp parallel for
-    for (int i = 0; i < (int)Slice->n_slices; ++i) {
-        const double a = omega_rf * Slice->bin_centers[i] + phi_rf;
-        array[i] = base[i] * std::cos(a);
-    }
-
+        mymath::trapezoid(sin_a, Slice->bin_centers.data(), n_slices);
     double ccoeff =
-        mymath::trapezoid(array, Slice->bin_centers.data(), Slice->n_slices);
+        mymath::trapezoid(cos_a, Slice->bin_centers.data(), n_slices);
 
     phi_beam = std::atan(scoeff / ccoeff) + constant::pi;
-
-    delete[] base;
-    delete[] array;
 }
 
 void PhaseLoop::phase_difference()
@@ -125,6 +138,7 @@ void PhaseLoop::radial_difference()
     auto Beam = Context::Beam;
 
     // Radial difference between beam and design orbit.*
+    Beam->require_double_precision("PhaseLoop::radial_difference");
     uint counter = RfP->counter;
     uint n = 0;
     double sum = 0;
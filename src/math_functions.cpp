@@ -0,0 +1,711 @@
+/*
+ * math_functions.cpp
+ */
+
+#include <blond/math_functions.h>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLOND_SIMD_DISPATCH
+#include <immintrin.h>
+#endif
+
+using namespace blond;
+using namespace blond::vdt::details;
+
+// The vector kernels below are line by line ports of vdt::fast_sincos and
+// vdt::fast_exp. Trailing elements go through the same vector code (padded
+// copy or masked lanes), so a value never depends on its position in the
+// array.
+
+namespace {
+
+    mymath::simd_isa_t detect_simd_isa()
+    {
+#ifdef BLOND_SIMD_DISPATCH
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return mymath::avx512_isa;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return mymath::avx2_isa;
+#endif
+        return mymath::scalar_isa;
+    }
+
+    mymath::simd_isa_t &active_simd_isa()
+    {
+        static mymath::simd_isa_t isa = detect_simd_isa();
+        return isa;
+    }
+
+
+    void sincos_scalar(const double *in, double *sin_out, double *cos_out,
+                       const int n)
+    {
+        // one branch-free loop per case so that the compiler vectorises them
+        double s, c;
+        if (sin_out && cos_out) {
+            for (int i = 0; i < n; ++i) {
+                vdt::fast_sincos(in[i], s, c);
+                sin_out[i] = s;
+                cos_out[i] = c;
+            }
+        } else if (sin_out) {
+            for (int i = 0; i < n; ++i) {
+                vdt::fast_sincos(in[i], s, c);
+                sin_out[i] = s;
+            }
+        } else {
+            for (int i = 0; i < n; ++i) {
+                vdt::fast_sincos(in[i], s, c);
+                cos_out[i] = c;
+            }
+        }
+    }
+
+    void exp_scalar(const double *in, double *out, const int n)
+    {
+        for (int i = 0; i < n; ++i)
+            out[i] = vdt::fast_exp(in[i]);
+    }
+
+#ifdef BLOND_SIMD_DISPATCH
+
+    // AVX2 + FMA, 4 doubles per vector
+
+    __attribute__((target("avx2,fma")))
+    inline void sincos_avx2_kernel(const __m256d xx, __m256d &s, __m256d &c)
+    {
+        const __m256d sign_bit = _mm256_set1_pd(-0.0);
+        const __m128i zero = _mm_setzero_si128();
+
+        __m256d x = _mm256_andnot_pd(sign_bit, xx);
+        __m128i q = _mm256_cvttpd_epi32(
+                        _mm256_mul_pd(_mm256_set1_pd(ONEOPIO4), x));
+        q = _mm_and_si128(_mm_add_epi32(q, _mm_set1_epi32(1)),
+                          _mm_set1_epi32(~1));
+        const __m256d y = _mm256_cvtepi32_pd(q);
+        x = _mm256_fnmadd_pd(y, _mm256_set1_pd(DP1), x);
+        x = _mm256_fnmadd_pd(y, _mm256_set1_pd(DP2), x);
+        x = _mm256_fnmadd_pd(y, _mm256_set1_pd(DP3), x);
+
+        const __m256d zz = _mm256_mul_pd(x, x);
+        __m256d ps = _mm256_set1_pd(C1sin);
+        ps = _mm256_fmadd_pd(ps, zz, _mm256_set1_pd(C2sin));
+        ps = _mm256_fmadd_pd(ps, zz, _mm256_set1_pd(C3sin));
+        ps = _mm256_fmadd_pd(ps, zz, _mm256_set1_pd(C4sin));
+        ps = _mm256_fmadd_pd(ps, zz, _mm256_set1_pd(C5sin));
+        ps = _mm256_fmadd_pd(ps, zz, _mm256_set1_pd(C6sin));
+        __m256d pc = _mm256_set1_pd(C1cos);
+        pc = _mm256_fmadd_pd(pc, zz, _mm256_set1_pd(C2cos));
+        pc = _mm256_fmadd_pd(pc, zz, _mm256_set1_pd(C3cos));
+        pc = _mm256_fmadd_pd(pc, zz, _mm256_set1_pd(C4cos));
+        pc = _mm256_fmadd_pd(pc, zz, _mm256_set1_pd(C5cos));
+        pc = _mm256_fmadd_pd(pc, zz, _mm256_set1_pd(C6cos));
+
+        const __m256d s0 = _mm256_fmadd_pd(_mm256_mul_pd(x, zz), ps, x);
+        const __m256d c0 = _mm256_fmadd_pd(
+                               _mm256_mul_pd(zz, zz), pc,
+                               _mm256_fnmadd_pd(zz, _mm256_set1_pd(0.5),
+                                                _mm256_set1_pd(1.0)));
+
+        // quadrant bookkeeping, widened to one 64-bit mask per lane
+        const __m128i j = _mm_sub_epi32(q, _mm_set1_epi32(2));
+        const __m256d keep_s = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(
+                                   _mm_cmpeq_epi32(_mm_and_si128(q, _mm_set1_epi32(4)), zero)));
+        const __m256d neg_c = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(
+                                  _mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), zero)));
+        const __m256d swap = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(
+                                 _mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), zero)));
+
+        s = _mm256_blendv_pd(s0, c0, swap);
+        c = _mm256_blendv_pd(c0, s0, swap);
+        c = _mm256_xor_pd(c, _mm256_and_pd(neg_c, sign_bit));
+        s = _mm256_xor_pd(s, _mm256_andnot_pd(keep_s, sign_bit));
+        s = _mm256_xor_pd(s, _mm256_and_pd(xx, sign_bit));
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline __m256d exp_avx2_kernel(const __m256d initial_x)
+    {
+        __m256d px = _mm256_floor_pd(_mm256_fmadd_pd(
+                                         _mm256_set1_pd(LOG2E), initial_x,
+                                         _mm256_set1_pd(0.5)));
+        const __m128i n = _mm256_cvttpd_epi32(px);
+
+        __m256d x = _mm256_fnmadd_pd(px, _mm256_set1_pd(6.93145751953125E-1),
+                                     initial_x);
+        x = _mm256_fnmadd_pd(px, _mm256_set1_pd(1.42860682030941723212E-6), x);
+        const __m256d xx = _mm256_mul_pd(x, x);
+
+        px = _mm256_set1_pd(PX1exp);
+        px = _mm256_fmadd_pd(px, xx, _mm256_set1_pd(PX2exp));
+        px = _mm256_fmadd_pd(px, xx, _mm256_set1_pd(PX3exp));
+        px = _mm256_mul_pd(px, x);
+
+        __m256d qx = _mm256_set1_pd(QX1exp);
+        qx = _mm256_fmadd_pd(qx, xx, _mm256_set1_pd(QX2exp));
+        qx = _mm256_fmadd_pd(qx, xx, _mm256_set1_pd(QX3exp));
+        qx = _mm256_fmadd_pd(qx, xx, _mm256_set1_pd(QX4exp));
+
+        x = _mm256_div_pd(px, _mm256_sub_pd(qx, px));
+        x = _mm256_fmadd_pd(_mm256_set1_pd(2.0), x, _mm256_set1_pd(1.0));
+
+        // build 2^n in double
+        const __m256i e = _mm256_slli_epi64(_mm256_add_epi64(
+                                                _mm256_cvtepi32_epi64(n),
+                                                _mm256_set1_epi64x(1023)), 52);
+        x = _mm256_mul_pd(x, _mm256_castsi256_pd(e));
+
+        const __m256d limit = _mm256_set1_pd(EXP_LIMIT);
+        x = _mm256_blendv_pd(x, _mm256_set1_pd(std::numeric_limits<double>::infinity()),
+                             _mm256_cmp_pd(initial_x, limit, _CMP_GT_OQ));
+        x = _mm256_blendv_pd(x, _mm256_setzero_pd(),
+                             _mm256_cmp_pd(initial_x, _mm256_sub_pd(_mm256_setzero_pd(), limit),
+                                           _CMP_LT_OQ));
+        return x;
+    }
+
+    __attribute__((target("avx2,fma")))
+    void sincos_avx2(const double *in, double *sin_out, double *cos_out,
+                     const int n)
+    {
+        int i = 0;
+        __m256d s, c;
+        for (; i + 4 <= n; i += 4) {
+            sincos_avx2_kernel(_mm256_loadu_pd(&in[i]), s, c);
+            if (sin_out) _mm256_storeu_pd(&sin_out[i], s);
+            if (cos_out) _mm256_storeu_pd(&cos_out[i], c);
+        }
+        if (i < n) {
+            const int rest = n - i;
+            double buf[4] = {0., 0., 0., 0.};
+            std::memcpy(buf, &in[i], rest * sizeof(double));
+            sincos_avx2_kernel(_mm256_loadu_pd(buf), s, c);
+            if (sin_out) {
+                _mm256_storeu_pd(buf, s);
+                std::memcpy(&sin_out[i], buf, rest * sizeof(double));
+            }
+            if (cos_out) {
+                _mm256_storeu_pd(buf, c);
+                std::memcpy(&cos_out[i], buf, rest * sizeof(double));
+            }
+        }
+    }
+
+    __attribute__((target("avx2,fma")))
+    void exp_avx2(const double *in, double *out, const int n)
+    {
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+            _mm256_storeu_pd(&out[i], exp_avx2_kernel(_mm256_loadu_pd(&in[i])));
+        if (i < n) {
+            const int rest = n - i;
+            double buf[4] = {0., 0., 0., 0.};
+            std::memcpy(buf, &in[i], rest * sizeof(double));
+            _mm256_storeu_pd(buf, exp_avx2_kernel(_mm256_loadu_pd(buf)));
+            std::memcpy(&out[i], buf, rest * sizeof(double));
+        }
+    }
+
+
+    // AVX-512F, 8 doubles per vector; the tail uses masked loads/stores.
+    // The undefined-value idiom inside gcc's avx512 headers trips
+    // -Wmaybe-uninitialized once inlined here.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+    __attribute__((target("avx512f,avx2,fma")))
+    inline void sincos_avx512_kernel(const __m512d xx, __m512d &s, __m512d &c)
+    {
+        const __m512i sign_bit = _mm512_set1_epi64(0x8000000000000000LL);
+
+        __m512d x = _mm512_castsi512_pd(_mm512_andnot_si512(
+                                            sign_bit, _mm512_castpd_si512(xx)));
+        __m256i q = _mm512_cvttpd_epi32(
+                        _mm512_mul_pd(_mm512_set1_pd(ONEOPIO4), x));
+        q = _mm256_and_si256(_mm256_add_epi32(q, _mm256_set1_epi32(1)),
+                             _mm256_set1_epi32(~1));
+        const __m512d y = _mm512_cvtepi32_pd(q);
+        x = _mm512_fnmadd_pd(y, _mm512_set1_pd(DP1), x);
+        x = _mm512_fnmadd_pd(y, _mm512_set1_pd(DP2), x);
+        x = _mm512_fnmadd_pd(y, _mm512_set1_pd(DP3), x);
+
+        const __m512d zz = _mm512_mul_pd(x, x);
+        __m512d ps = _mm512_set1_pd(C1sin);
+        ps = _mm512_fmadd_pd(ps, zz, _mm512_set1_pd(C2sin));
+        ps = _mm512_fmadd_pd(ps, zz, _mm512_set1_pd(C3sin));
+        ps = _mm512_fmadd_pd(ps, zz, _mm512_set1_pd(C4sin));
+        ps = _mm512_fmadd_pd(ps, zz, _mm512_set1_pd(C5sin));
+        ps = _mm512_fmadd_pd(ps, zz, _mm512_set1_pd(C6sin));
+        __m512d pc = _mm512_set1_pd(C1cos);
+        pc = _mm512_fmadd_pd(pc, zz, _mm512_set1_pd(C2cos));
+        pc = _mm512_fmadd_pd(pc, zz, _mm512_set1_pd(C3cos));
+        pc = _mm512_fmadd_pd(pc, zz, _mm512_set1_pd(C4cos));
+        pc = _mm512_fmadd_pd(pc, zz, _mm512_set1_pd(C5cos));
+        pc = _mm512_fmadd_pd(pc, zz, _mm512_set1_pd(C6cos));
+
+        const __m512d s0 = _mm512_fmadd_pd(_mm512_mul_pd(x, zz), ps, x);
+        const __m512d c0 = _mm512_fmadd_pd(
+                               _mm512_mul_pd(zz, zz), pc,
+                               _mm512_fnmadd_pd(zz, _mm512_set1_pd(0.5),
+                                                _mm512_set1_pd(1.0)));
+
+        const __m512i q64 = _mm512_cvtepi32_epi64(q);
+        const __m512i j64 = _mm512_sub_epi64(q64, _mm512_set1_epi64(2));
+        const __mmask8 neg_s = _mm512_test_epi64_mask(q64, _mm512_set1_epi64(4));
+        const __mmask8 keep_c = _mm512_test_epi64_mask(j64, _mm512_set1_epi64(4));
+        const __mmask8 no_swap = _mm512_test_epi64_mask(j64, _mm512_set1_epi64(2));
+
+        __m512i si = _mm512_castpd_si512(_mm512_mask_blend_pd(no_swap, c0, s0));
+        __m512i ci = _mm512_castpd_si512(_mm512_mask_blend_pd(no_swap, s0, c0));
+        ci = _mm512_mask_xor_epi64(ci, (__mmask8) ~keep_c, ci, sign_bit);
+        si = _mm512_mask_xor_epi64(si, neg_s, si, sign_bit);
+        si = _mm512_xor_si512(si, _mm512_and_si512(_mm512_castpd_si512(xx),
+                                                   sign_bit));
+        s = _mm512_castsi512_pd(si);
+        c = _mm512_castsi512_pd(ci);
+    }
+
+    __attribute__((target("avx512f,avx2,fma")))
+    inline __m512d exp_avx512_kernel(const __m512d initial_x)
+    {
+        __m512d px = _mm512_roundscale_pd(
+                         _mm512_fmadd_pd(_mm512_set1_pd(LOG2E), initial_x,
+                                         _mm512_set1_pd(0.5)),
+                         _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        const __m256i n = _mm512_cvttpd_epi32(px);
+
+        __m512d x = _mm512_fnmadd_pd(px, _mm512_set1_pd(6.93145751953125E-1),
+                                     initial_x);
+        x = _mm512_fnmadd_pd(px, _mm512_set1_pd(1.42860682030941723212E-6), x);
+        const __m512d xx = _mm512_mul_pd(x, x);
+
+        px = _mm512_set1_pd(PX1exp);
+        px = _mm512_fmadd_pd(px, xx, _mm512_set1_pd(PX2exp));
+        px = _mm512_fmadd_pd(px, xx, _mm512_set1_pd(PX3exp));
+        px = _mm512_mul_pd(px, x);
+
+        __m512d qx = _mm512_set1_pd(QX1exp);
+        qx = _mm512_fmadd_pd(qx, xx, _mm512_set1_pd(QX2exp));
+        qx = _mm512_fmadd_pd(qx, xx, _mm512_set1_pd(QX3exp));
+        qx = _mm512_fmadd_pd(qx, xx, _mm512_set1_pd(QX4exp));
+
+        x = _mm512_div_pd(px, _mm512_sub_pd(qx, px));
+        x = _mm512_fmadd_pd(_mm512_set1_pd(2.0), x, _mm512_set1_pd(1.0));
+
+        const __m512i e = _mm512_slli_epi64(_mm512_add_epi64(
+                                                _mm512_cvtepi32_epi64(n),
+                                                _mm512_set1_epi64(1023)), 52);
+        x = _mm512_mul_pd(x, _mm512_castsi512_pd(e));
+
+        const __m512d limit = _mm512_set1_pd(EXP_LIMIT);
+        x = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(initial_x, limit, _CMP_GT_OQ),
+                                 x, _mm512_set1_pd(std::numeric_limits<double>::infinity()));
+        x = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(initial_x,
+                                                    _mm512_sub_pd(_mm512_setzero_pd(), limit),
+                                                    _CMP_LT_OQ),
+                                 x, _mm512_setzero_pd());
+        return x;
+    }
+
+    __attribute__((target("avx512f,avx2,fma")))
+    void sincos_avx512(const double *in, double *sin_out, double *cos_out,
+                       const int n)
+    {
+        __m512d s, c;
+        for (int i = 0; i < n; i += 8) {
+            const __mmask8 m = n - i >= 8 ? 0xFF : (__mmask8)((1u << (n - i)) - 1);
+            sincos_avx512_kernel(_mm512_maskz_loadu_pd(m, &in[i]), s, c);
+            if (sin_out) _mm512_mask_storeu_pd(&sin_out[i], m, s);
+            if (cos_out) _mm512_mask_storeu_pd(&cos_out[i], m, c);
+        }
+    }
+
+    __attribute__((target("avx512f,avx2,fma")))
+    void exp_avx512(const double *in, double *out, const int n)
+    {
+        for (int i = 0; i < n; i += 8) {
+            const __mmask8 m = n - i >= 8 ? 0xFF : (__mmask8)((1u << (n - i)) - 1);
+            _mm512_mask_storeu_pd(&out[i], m,
+                                  exp_avx512_kernel(_mm512_maskz_loadu_pd(m, &in[i])));
+        }
+    }
+
+#pragma GCC diagnostic pop
+
+#endif // BLOND_SIMD_DISPATCH
+
+    inline void sincos_dispatch(const double *in, double *sin_out,
+                                double *cos_out, const int n)
+    {
+        switch (active_simd_isa()) {
+#ifdef BLOND_SIMD_DISPATCH
+        case mymath::avx512_isa:
+            sincos_avx512(in, sin_out, cos_out, n);
+            break;
+        case mymath::avx2_isa:
+            sincos_avx2(in, sin_out, cos_out, n);
+            break;
+#endif
+        default:
+            sincos_scalar(in, sin_out, cos_out, n);
+        }
+    }
+
+
+    // Sum of squared residuals of a * exp(-(u - m)^2 / (2 s^2)), q = {a, m,
+    // s}, over the normalised points u = (x - x0) / x_scale and
+    // y / y_scale. With jtj, also the upper triangle of J^T J (row major
+    // a-a, a-m, a-s, m-m, m-s, s-s) and J^T r.
+    double gaussian_residuals(const double *__restrict x,
+                              const double *__restrict y, const int n,
+                              const double x0, const double x_scale,
+                              const double y_scale, const double q[3],
+                              double jtj[6], double jtr[3])
+    {
+        const double inv_s = 1. / q[2];
+        double chi2 = 0.;
+        if (jtj) {
+            std::fill_n(jtj, 6, 0.);
+            std::fill_n(jtr, 3, 0.);
+        }
+        for (int i = 0; i < n; ++i) {
+            const double d = ((x[i] - x0) / x_scale - q[1]) * inv_s;
+            const double e = std::exp(-0.5 * d * d);
+            const double r = y[i] / y_scale - q[0] * e;
+            chi2 += r * r;
+            if (!jtj) continue;
+            const double j_a = e;
+            const double j_m = q[0] * e * d * inv_s;
+            const double j_s = j_m * d;
+            jtj[0] += j_a * j_a;
+            jtj[1] += j_a * j_m;
+            jtj[2] += j_a * j_s;
+            jtj[3] += j_m * j_m;
+            jtj[4] += j_m * j_s;
+            jtj[5] += j_s * j_s;
+            jtr[0] += j_a * r;
+            jtr[1] += j_m * r;
+            jtr[2] += j_s * r;
+        }
+        return chi2;
+    }
+
+    // Solves the symmetric 3x3 system a x = b, a as in gaussian_residuals()
+    bool solve3(const double a[6], const double b[3], double x[3])
+    {
+        const double c00 = a[3] * a[5] - a[4] * a[4];
+        const double c01 = a[2] * a[4] - a[1] * a[5];
+        const double c02 = a[1] * a[4] - a[2] * a[3];
+        const double det = a[0] * c00 + a[1] * c01 + a[2] * c02;
+        if (!(std::abs(det) > 0.) || !std::isfinite(det)) return false;
+        const double c11 = a[0] * a[5] - a[2] * a[2];
+        const double c12 = a[1] * a[2] - a[0] * a[4];
+        const double c22 = a[0] * a[3] - a[1] * a[1];
+        x[0] = (c00 * b[0] + c01 * b[1] + c02 * b[2]) / det;
+        x[1] = (c01 * b[0] + c11 * b[1] + c12 * b[2]) / det;
+        x[2] = (c02 * b[0] + c12 * b[1] + c22 * b[2]) / det;
+        return true;
+    }
+
+} // anonymous namespace
+
+
+mymath::simd_isa_t mymath::simd_isa()
+{
+    return active_simd_isa();
+}
+
+void mymath::set_simd_isa(simd_isa_t isa)
+{
+    active_simd_isa() = std::min(isa, detect_simd_isa());
+}
+
+void mymath::fast_sin_v(const double *in, double *out, const int n)
+{
+    sincos_dispatch(in, out, nullptr, n);
+}
+
+void mymath::fast_cos_v(const double *in, double *out, const int n)
+{
+    sincos_dispatch(in, nullptr, out, n);
+}
+
+void mymath::fast_sincos_v(const double *in, double *sin_out,
+                           double *cos_out, const int n)
+{
+    sincos_dispatch(in, sin_out, cos_out, n);
+}
+
+void mymath::fast_exp_v(const double *in, double *out, const int n)
+{
+    switch (active_simd_isa()) {
+#ifdef BLOND_SIMD_DISPATCH
+    case avx512_isa:
+        exp_avx512(in, out, n);
+        break;
+    case avx2_isa:
+        exp_avx2(in, out, n);
+        break;
+#endif
+    default:
+        exp_scalar(in, out, n);
+    }
+}
+
+// The fit runs in coordinates normalised by the start point, so that the
+// three parameters are of order one and the normal matrix well conditioned
+// whatever the units of the profile.
+bool mymath::gaussian_fit(const double *__restrict x,
+                          const double *__restrict y, const int n,
+                          double p[3])
+{
+    const int max_iterations = 200;
+    const double tolerance = 1e-12;
+
+    const double y_scale = p[0] != 0. ? std::abs(p[0]) : 1.;
+    const double x0 = p[1];
+    const double x_scale = p[2] != 0. ? std::abs(p[2]) : 1.;
+    double q[3] = {p[0] / y_scale, 0., p[2] != 0. ? p[2] / x_scale : 1.};
+
+    double jtj[6], jtr[3], damped[6], step[3], trial[3];
+    double chi2 = gaussian_residuals(x, y, n, x0, x_scale, y_scale, q,
+                                     jtj, jtr);
+    double lambda = 1e-3;
+    bool converged = false;
+
+    for (int it = 0; it < max_iterations && !converged; ++it) {
+        bool accepted = false;
+        while (!accepted) {
+            // Marquardt's scaling of the damping by the diagonal
+            std::copy(jtj, jtj + 6, damped);
+            damped[0] *= 1. + lambda;
+            damped[3] *= 1. + lambda;
+            damped[5] *= 1. + lambda;
+            if (solve3(damped, jtr, step)) {
+                for (int k = 0; k < 3; ++k) trial[k] = q[k] + step[k];
+                const double trial_chi2 = gaussian_residuals(x, y, n, x0,
+                                          x_scale, y_scale, trial,
+                                          nullptr, nullptr);
+                if (trial_chi2 <= chi2) {
+                    const double scale = std::abs(trial[2]);
+                    converged = std::abs(step[0]) <= tolerance * std::abs(trial[0])
+                                && std::abs(step[1]) <= tolerance * scale
+                                && std::abs(step[2]) <= tolerance * scale;
+                    converged |= chi2 - trial_chi2 <= tolerance * tolerance * chi2;
+                    std::copy(trial, trial + 3, q);
+                    chi2 = gaussian_residuals(x, y, n, x0, x_scale, y_scale,
+                                              q, jtj, jtr);
+                    lambda = std::max(lambda / 10., 1e-12);
+                    accepted = true;
+                    continue;
+                }
+            }
+            lambda *= 10.;
+            // No downhill step left, q is a minimum to working precision
+            if (lambda > 1e16) {
+                converged = true;
+                break;
+            }
+        }
+    }
+
+    p[0] = q[0] * y_scale;
+    p[1] = x0 + q[1] * x_scale;
+    p[2] = q[2] * x_scale;
+    return converged && std::isfinite(p[0]) && std::isfinite(p[1])
+           && std::isfinite(p[2]);
+}
+
+
+namespace {
+
+    // Coefficients of the monic polynomial with the given roots, highest
+    // power first, as numpy.poly
+    void poly(const std::vector<complex_t> &roots,
+              std::vector<complex_t> &c)
+    {
+        c.assign(1, complex_t(1., 0.));
+        for (const auto &r : roots) {
+            c.push_back(complex_t(0., 0.));
+            for (int k = c.size() - 1; k > 0; --k)
+                c[k] -= r * c[k - 1];
+        }
+    }
+
+    // Solves the n x n system a x = b in place by Gaussian elimination
+    // with partial pivoting, a row major
+    void solve(f_vector_t &a, f_vector_t &b, const int n)
+    {
+        for (int c = 0; c < n; ++c) {
+            int pivot = c;
+            for (int r = c + 1; r < n; ++r)
+                if (std::abs(a[r * n + c]) > std::abs(a[pivot * n + c]))
+                    pivot = r;
+            if (pivot != c) {
+                for (int k = 0; k < n; ++k)
+                    std::swap(a[c * n + k], a[pivot * n + k]);
+                std::swap(b[c], b[pivot]);
+            }
+            for (int r = c + 1; r < n; ++r) {
+                const double f = a[r * n + c] / a[c * n + c];
+                for (int k = c; k < n; ++k) a[r * n + k] -= f * a[c * n + k];
+                b[r] -= f * b[c];
+            }
+        }
+        for (int r = n - 1; r >= 0; --r) {
+            for (int k = r + 1; k < n; ++k) b[r] -= a[r * n + k] * b[k];
+            b[r] /= a[r * n + r];
+        }
+    }
+
+    // Direct form II transposed pass over n points, starting from the
+    // state z, which is left at the final state
+    void lfilter(const f_vector_t &b, const f_vector_t &a, double *z,
+                 const double *x, double *y, const int n, const int step)
+    {
+        const int m = b.size() - 1;
+        for (int i = 0; i < n; ++i) {
+            const double in = x[i * step];
+            const double out = b[0] * in + z[0];
+            for (int k = 0; k < m - 1; ++k)
+                z[k] = b[k + 1] * in + z[k + 1] - a[k + 1] * out;
+            z[m - 1] = b[m] * in - a[m] * out;
+            y[i * step] = out;
+        }
+    }
+}
+
+int mymath::cheb2ord(const double wp, const double ws, const double gpass,
+                     const double gstop, double &wn)
+{
+    // Pre-warped band edges
+    const double passb = std::tan(M_PI * wp / 2.);
+    const double stopb = std::tan(M_PI * ws / 2.);
+    const bool lowpass = wp < ws;
+    const double nat = std::abs(lowpass ? stopb / passb : passb / stopb);
+
+    const double g_stop = std::pow(10., 0.1 * std::abs(gstop));
+    const double g_pass = std::pow(10., 0.1 * std::abs(gpass));
+    const double ripple = std::acosh(std::sqrt((g_stop - 1.) / (g_pass - 1.)));
+    const int order = std::ceil(ripple / std::acosh(nat));
+
+    // Where the analog response is -gpass dB, back to the original band
+    const double new_freq = 1. / std::cosh(ripple / order);
+    wn = 2. / M_PI * std::atan(lowpass ? passb / new_freq
+                                       : passb * new_freq);
+    return order;
+}
+
+void mymath::cheby2(const int order, const double gstop, const double wn,
+                    f_vector_t &b, f_vector_t &a)
+{
+    // Analog prototype
+    const double de = 1. / std::sqrt(std::pow(10., 0.1 * gstop) - 1.);
+    const double mu = std::asinh(1. / de) / order;
+    std::vector<complex_t> z, p;
+    for (int m = -order + 1; m < order; m += 2)
+        if (m != 0)
+            z.push_back(complex_t(0., 1. / std::sin(m * M_PI / (2. * order))));
+    for (int m = -order + 1; m < order; m += 2) {
+        const complex_t u = -std::exp(complex_t(0., M_PI * m / (2. * order)));
+        p.push_back(1. / complex_t(std::sinh(mu) * u.real(),
+                                   std::cosh(mu) * u.imag()));
+    }
+    complex_t num(1., 0.), den(1., 0.);
+    for (const auto &x : p) num *= -x;
+    for (const auto &x : z) den *= -x;
+    double k = (num / den).real();
+
+    // Low-pass to the pre-warped cutoff, then the bilinear transform at a
+    // sampling frequency of 2
+    const double fs2 = 4.;
+    const double warped = fs2 * std::tan(M_PI * wn / 2.);
+    const int degree = p.size() - z.size();
+    k *= std::pow(warped, degree);
+    complex_t k_num(1., 0.), k_den(1., 0.);
+    for (auto &x : z) {
+        x *= warped;
+        k_num *= fs2 - x;
+        x = (fs2 + x) / (fs2 - x);
+    }
+    for (auto &x : p) {
+        x *= warped;
+        k_den *= fs2 - x;
+        x = (fs2 + x) / (fs2 - x);
+    }
+    z.insert(z.end(), degree, complex_t(-1., 0.));
+    k *= (k_num / k_den).real();
+
+    // The roots come in conjugate pairs, the coefficients are real
+    std::vector<complex_t> c;
+    poly(z, c);
+    b.resize(c.size());
+    for (uint i = 0; i < c.size(); ++i) b[i] = k * c[i].real();
+    poly(p, c);
+    a.resize(c.size());
+    for (uint i = 0; i < c.size(); ++i) a[i] = c[i].real();
+}
+
+void mymath::lfilter_zi(const f_vector_t &b, const f_vector_t &a,
+                        f_vector_t &zi)
+{
+    // (I - A^T) zi = b[1:] - a[1:] b[0], A the companion matrix of a
+    const int n = b.size() - 1;
+    f_vector_t m(n * n, 0.);
+    zi.resize(n);
+    for (int i = 0; i < n; ++i) {
+        m[i * n] += a[i + 1] / a[0];
+        m[i * n + i] += 1.;
+        if (i + 1 < n) m[i * n + i + 1] -= 1.;
+        zi[i] = b[i + 1] / a[0] - a[i + 1] / a[0] * b[0] / a[0];
+    }
+    solve(m, zi, n);
+}
+
+void mymath::filtfilt(const f_vector_t &b, const f_vector_t &a,
+                      const f_vector_t &zi, const double *x, double *y,
+                      const int n, f_vector_t &work)
+{
+    const int m = b.size() - 1;
+    const int edge = 3 * (m + 1);
+    if (n <= edge) {
+        std::cerr << "[filtfilt] The signal must be longer than "
+                  << edge << " points\n";
+        exit(-1);
+    }
+
+    // Odd extension, then the state of the two passes at the end of the
+    // work array
+    const int len = n + 2 * edge;
+    work.resize(len + m);
+    double *ext = work.data();
+    double *z = &work[len];
+    for (int i = 0; i < edge; ++i) {
+        ext[i] = 2. * x[0] - x[edge - i];
+        ext[edge + n + i] = 2. * x[n - 1] - x[n - 2 - i];
+    }
+    std::copy(x, x + n, &ext[edge]);
+
+    for (int k = 0; k < m; ++k) z[k] = zi[k] * ext[0];
+    lfilter(b, a, z, ext, ext, len, 1);
+    for (int k = 0; k < m; ++k) z[k] = zi[k] * ext[len - 1];
+    lfilter(b, a, z, &ext[len - 1], &ext[len - 1], len, -1);
+
+    std::copy(&ext[edge], &ext[edge + n], y);
+}
+
+void mymath::freqz(const f_vector_t &b, const f_vector_t &a, const int n,
+                   double *__restrict w, complex_t *__restrict h)
+{
+    for (int k = 0; k < n; ++k) {
+        w[k] = M_PI * k / n;
+        const complex_t zm1 = std::exp(complex_t(0., -w[k]));
+        complex_t num(0., 0.), den(0., 0.);
+        for (int i = b.size() - 1; i >= 0; --i) num = num * zm1 + b[i];
+        for (int i = a.size() - 1; i >= 0; --i) den = den * zm1 + a[i];
+        h[k] = num / den;
+    }
+}
@@ -149,7 +149,7 @@ void SlicesMonitor::close()
 BunchMonitor::BunchMonitor(GeneralParameters *GP, RfParameters *RfP, Beams *Beam,
                            std::string filename, int buffer_time,
                            Slices *Slices, PhaseLoop *PL, LHCNoiseFB *noiseFB,
-                           int compression_level)
+                           int compression_level, bool streamed_statistics)
 {
     fFileName = filename;
     fNTurns = GP->n_turns;
@@ -163,7 +163,9 @@ BunchMonitor::BunchMonitor(GeneralParameters *GP, RfParameters *RfP, Beams *Beam
     fH5File = new H5File(fFileName, H5F_ACC_TRUNC);
     fH5Group = new Group(fH5File->createGroup("Beam"));
     fCompressionLevel = compression_level;
-
+    fStreamedStatistics = streamed_statistics;
+    if (fStreamedStatistics)
+        fBeam->stream_statistics = true;
 
     if (fSlices != NULL && fSlices->fit_option == Slices::fit_t::gaussian)
         fGaussian = true;
@@ -186,7 +188,10 @@ BunchMonitor::~BunchMonitor()
 
 void BunchMonitor::track()
 {
-    fBeam->statistics();
+    // Only if the slicing of the turn did not stream them
+    if (!fStreamedStatistics || !fBeam->statistics_streamed)
+        fBeam->statistics();
+    fBeam->statistics_streamed = false;
     if (fITurn <= fNTurns)
         write_buffer();
     fITurn++;
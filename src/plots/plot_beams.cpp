@@ -19,6 +19,7 @@ int blond::plot_long_phase_space(GeneralParameters *GP, RfParameters *RfP,
     auto pRfPCounter = python::convert_int(turn);
     auto pRfPOmegaRf0 = python::convert_double(RfP->omega_rf[0][turn]);
     auto pRfPPhiRf0 = python::convert_double(RfP->phi_rf[0][turn]);
+    Beam->require_double_precision("plot_long_phase_space");
     auto pBeamDE = python::convert_double_array(Beam->dE.data(), Beam->dE.size());
     auto pBeamDt = python::convert_double_array(Beam->dt.data(), Beam->dt.size());
     auto pBeamId = python::convert_int_array(Beam->id.data(), Beam->id.size());
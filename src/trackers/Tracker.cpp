@@ -8,6 +8,7 @@
 #include <blond/constants.h>
 #include <blond/math_functions.h>
 #include <blond/trackers/Tracker.h>
+#include <cstring>
 #include <iterator>
 #include <blond/vector_math.h>
 
@@ -15,9 +16,186 @@ using namespace blond;
 using namespace std;
 using namespace mymath;
 
+// Particles per block of the fused kernel, dt and dE of a block
+// (2 * 8 * 4096 bytes) stay in L2 between kick, drift and histogram
+static const int FUSED_BLOCK_SIZE = 4096;
+
+// Particles per chunk of the kick, the phases of a chunk are
+// evaluated with one call to the vectorised sine
+static const int KICK_CHUNK_SIZE = 256;
+
+// Kick of the particles in [start, end). All the RF harmonics and the
+// synchronous energy change are summed per particle, in the same order
+// as applying them one harmonic at a time.
+// N_RF > 0 fixes the number of harmonics at compile time so that the
+// harmonic loop is unrolled, N_RF == 0 falls back to the run-time n_rf.
+// The coordinates may be stored in float or double, the energy change is
+// accumulated in double either way.
+// When the build already targets AVX2 or wider, the compiler vectorises
+// the inline fast_sin over the whole loop at full width and that beats
+// going through a buffer; otherwise (portable builds) the phases of each
+// chunk go through the runtime dispatched fast_sin_v.
+template <int N_RF, typename real_t>
+static inline void kick_particles(const real_t *__restrict beam_dt,
+                                  real_t *__restrict beam_dE,
+                                  const int n_rf,
+                                  const double *__restrict voltage,
+                                  const double *__restrict omega_rf,
+                                  const double *__restrict phi_rf,
+                                  const double acc_kick,
+                                  const int start,
+                                  const int end)
+{
+    const int harmonics = N_RF > 0 ? N_RF : n_rf;
+#ifdef __AVX2__
+    for (int i = start; i < end; ++i) {
+        double dE = beam_dE[i];
+        for (int j = 0; j < harmonics; ++j) {
+            const double a = omega_rf[j] * beam_dt[i] + phi_rf[j];
+            dE += voltage[j] * fast_sin(a);
+        }
+        beam_dE[i] = dE + acc_kick;
+    }
+#else
+    double phase[KICK_CHUNK_SIZE];
+    double sum[KICK_CHUNK_SIZE];
+    for (int k = start; k < end; k += KICK_CHUNK_SIZE) {
+        const int len = std::min(KICK_CHUNK_SIZE, end - k);
+        const real_t *__restrict dt = &beam_dt[k];
+        real_t *__restrict dE = &beam_dE[k];
+        for (int i = 0; i < len; ++i)
+            sum[i] = dE[i];
+        for (int j = 0; j < harmonics; ++j) {
+            for (int i = 0; i < len; ++i)
+                phase[i] = omega_rf[j] * dt[i] + phi_rf[j];
+            fast_sin_v(phase, phase, len);
+            for (int i = 0; i < len; ++i)
+                sum[i] += voltage[j] * phase[i];
+        }
+        for (int i = 0; i < len; ++i)
+            dE[i] = sum[i] + acc_kick;
+    }
+#endif
+}
 
-inline void RingAndRfSection::kick(const double *__restrict beam_dt,
-                                   double *__restrict beam_dE,
+template <typename real_t>
+static inline void kick_particles(const real_t *__restrict beam_dt,
+                                  real_t *__restrict beam_dE,
+                                  const int n_rf,
+                                  const double *__restrict voltage,
+                                  const double *__restrict omega_rf,
+                                  const double *__restrict phi_rf,
+                                  const double acc_kick,
+                                  const int start,
+                                  const int end)
+{
+    switch (n_rf) {
+        case 1:
+            kick_particles<1, real_t>(beam_dt, beam_dE, n_rf, voltage, omega_rf,
+                                      phi_rf, acc_kick, start, end);
+            break;
+        case 2:
+            kick_particles<2, real_t>(beam_dt, beam_dE, n_rf, voltage, omega_rf,
+                                      phi_rf, acc_kick, start, end);
+            break;
+        case 3:
+            kick_particles<3, real_t>(beam_dt, beam_dE, n_rf, voltage, omega_rf,
+                                      phi_rf, acc_kick, start, end);
+            break;
+        case 4:
+            kick_particles<4, real_t>(beam_dt, beam_dE, n_rf, voltage, omega_rf,
+                                      phi_rf, acc_kick, start, end);
+            break;
+        default:
+            kick_particles<0, real_t>(beam_dt, beam_dE, n_rf, voltage, omega_rf,
+                                      phi_rf, acc_kick, start, end);
+            break;
+    }
+}
+
+// Kick of the particles in [start, end) by linear interpolation in the RF
+// voltage tabulated over one period of n_points intervals. The table holds
+// the value at the start of every interval and the slope to the next one,
+// so one pair of adjacent loads serves a particle.
+template <typename real_t>
+static inline void tabulated_kick_particles(const real_t *__restrict beam_dt,
+        real_t *__restrict beam_dE,
+        const double *__restrict table,
+        const double inv_step,
+        const int n_points,
+        const double acc_kick,
+        const int start,
+        const int end)
+{
+    const double inv_n = 1. / n_points;
+    for (int i = start; i < end; ++i) {
+        const double u = beam_dt[i] * inv_step;
+        const double w = u - std::floor(u * inv_n) * n_points;
+        const int k = std::min((int) w, n_points - 1);
+        const double frac = w - k;
+        beam_dE[i] += table[2 * k] + frac * table[2 * k + 1] + acc_kick;
+    }
+}
+
+// The two ways of kicking a block of particles, so that the block loops
+// below are written once for both
+struct direct_kick_t {
+    int n_rf;
+    const double *voltage;
+    const double *omega_rf;
+    const double *phi_rf;
+    double acc_kick;
+
+    template <typename real_t>
+    void operator()(const real_t *__restrict beam_dt,
+                    real_t *__restrict beam_dE,
+                    const int start, const int end) const
+    {
+        kick_particles(beam_dt, beam_dE, n_rf, voltage, omega_rf, phi_rf,
+                       acc_kick, start, end);
+    }
+};
+
+struct tabulated_kick_t {
+    const double *table;
+    double inv_step;
+    int n_points;
+    double acc_kick;
+
+    template <typename real_t>
+    void operator()(const real_t *__restrict beam_dt,
+                    real_t *__restrict beam_dE,
+                    const int start, const int end) const
+    {
+        tabulated_kick_particles(beam_dt, beam_dE, table, inv_step, n_points,
+                                 acc_kick, start, end);
+    }
+};
+
+template <typename real_t, typename kick_t>
+static void kick_chunks(const real_t *__restrict beam_dt,
+                        real_t *__restrict beam_dE,
+                        const kick_t &kick,
+                        const int n_macroparticles)
+{
+    #pragma omp parallel
+    {
+        const int id = omp_get_thread_num();
+        const int threads = omp_get_num_threads();
+        // whole SIMD vectors per thread: with aligned storage every chunk
+        // starts on a cache line and no line is written by two threads
+        const int chunk = simd_padded_size<real_t>(
+                              (n_macroparticles + threads - 1) / threads);
+        const int start = std::min(id * chunk, n_macroparticles);
+        const int end = std::min(start + chunk, n_macroparticles);
+
+        kick(beam_dt, beam_dE, start, end);
+    }
+}
+
+template <typename real_t>
+inline void RingAndRfSection::kick(const real_t *__restrict beam_dt,
+                                   real_t *__restrict beam_dE,
                                    const int n_rf,
                                    const double *__restrict voltage,
                                    const double *__restrict omega_rf,
@@ -25,25 +203,138 @@ inline void RingAndRfSection::kick(const double *__restrict beam_dt,
                                    const int n_macroparticles,
                                    const double acc_kick)
 {
-    // KICK
-    //#pragma omp parallel for collapse(2)
-    for (int j = 0; j < n_rf; ++j) {
-        #pragma omp parallel for
-        for (int i = 0; i < n_macroparticles; ++i) {
-            const double a = omega_rf[j] * beam_dt[i] + phi_rf[j];
-            beam_dE[i] += voltage[j] * fast_sin(a);
+    // KICK AND SYNCHRONOUS ENERGY CHANGE
+    const direct_kick_t kicker = {n_rf, voltage, omega_rf, phi_rf, acc_kick};
+    kick_chunks(beam_dt, beam_dE, kicker, n_macroparticles);
+}
+
+
+// Coefficients of the drift of one turn
+struct drift_coefficients_t {
+    double T;
+    double T_x_coeff;
+    double eta0;
+    double eta1;
+    double eta2;
+};
+
+static inline drift_coefficients_t drift_coefficients(const double T0,
+        const double length_ratio,
+        const double eta_zero,
+        const double eta_one,
+        const double eta_two,
+        const double beta,
+        const double energy)
+{
+    drift_coefficients_t c;
+    c.T = T0 * length_ratio;
+    c.T_x_coeff = c.T * eta_zero / (beta * beta * energy);
+    const double coeff = 1. / (beta * beta * energy);
+    c.eta0 = eta_zero * coeff;
+    c.eta1 = eta_one * coeff * coeff;
+    c.eta2 = eta_two * coeff * coeff * coeff;
+    return c;
+}
+
+// 0 for the simple solver, else the order of the momentum compaction
+// expansion used by the full solver; any other alpha_order uses all three
+static inline int drift_order(const RingAndRfSection::solver_type solver,
+                              const int alpha_order)
+{
+    if (solver == RingAndRfSection::simple) return 0;
+    if (alpha_order == 1 || alpha_order == 2) return alpha_order;
+    return 3;
+}
+
+// 1 / d, either exact or from the single precision estimate refined by one
+// Newton step, which doubles its 24 correct bits
+template <bool FAST_RECIPROCAL>
+static inline double reciprocal(const double d)
+{
+    if (!FAST_RECIPROCAL) return 1. / d;
+    const double r = 1.f / (float) d;
+    return r * (2. - d * r);
+}
+
+// Drift of the particles in [start, end). ORDER is drift_order(), fixed at
+// compile time so that every loop is a single branch free expression.
+// The full solver drift is T * (1 / (1 - x) - 1), with
+// x = eta0 dE + eta1 dE^2 + eta2 dE^3, evaluated as in the reference
+// solver. The fast reciprocal variant evaluates the same quantity as
+// T * x / (1 - x), with x in Horner form, which avoids the cancellation of
+// the subtraction.
+template <int ORDER, bool FAST_RECIPROCAL, typename real_t>
+static inline void drift_particles(real_t *__restrict beam_dt,
+                                   const real_t *__restrict beam_dE,
+                                   const drift_coefficients_t &c,
+                                   const int start,
+                                   const int end)
+{
+    if (ORDER == 0) {
+        for (int i = start; i < end; i++)
+            beam_dt[i] += c.T_x_coeff * beam_dE[i];
+        return;
+    }
+
+    if (FAST_RECIPROCAL) {
+        for (int i = start; i < end; i++) {
+            const double dE = beam_dE[i];
+            const double x = ORDER == 1 ? c.eta0 * dE
+                             : ORDER == 2 ? dE * (c.eta0 + c.eta1 * dE)
+                             : dE * (c.eta0 + dE * (c.eta1 + c.eta2 * dE));
+            beam_dt[i] += c.T * x * reciprocal<FAST_RECIPROCAL>(1. - x);
         }
+        return;
     }
 
-// SYNCHRONOUS ENERGY CHANGE
-    #pragma omp parallel for
-    for (int i = 0; i < n_macroparticles; ++i)
-        beam_dE[i] += acc_kick;
+    for (int i = start; i < end; i++) {
+        const double dE = beam_dE[i];
+        const double d = ORDER == 1 ? 1. - c.eta0 * dE
+                         : ORDER == 2 ? 1. - c.eta0 * dE - c.eta1 * dE * dE
+                         : 1. - c.eta0 * dE - c.eta1 * dE * dE
+                         - c.eta2 * dE * dE * dE;
+        beam_dt[i] += c.T * (1. / d - 1.);
+    }
 }
 
+template <typename real_t>
+static inline void drift_particles(real_t *__restrict beam_dt,
+                                   const real_t *__restrict beam_dE,
+                                   const int order,
+                                   const bool fast_reciprocal,
+                                   const drift_coefficients_t &c,
+                                   const int start,
+                                   const int end)
+{
+    switch (2 * order + fast_reciprocal) {
+        case 0:
+        case 1:
+            drift_particles<0, false>(beam_dt, beam_dE, c, start, end);
+            break;
+        case 2:
+            drift_particles<1, false>(beam_dt, beam_dE, c, start, end);
+            break;
+        case 3:
+            drift_particles<1, true>(beam_dt, beam_dE, c, start, end);
+            break;
+        case 4:
+            drift_particles<2, false>(beam_dt, beam_dE, c, start, end);
+            break;
+        case 5:
+            drift_particles<2, true>(beam_dt, beam_dE, c, start, end);
+            break;
+        case 6:
+            drift_particles<3, false>(beam_dt, beam_dE, c, start, end);
+            break;
+        default:
+            drift_particles<3, true>(beam_dt, beam_dE, c, start, end);
+            break;
+    }
+}
 
-inline void RingAndRfSection::drift(double *__restrict beam_dt,
-                                    const double *__restrict beam_dE,
+template <typename real_t>
+inline void RingAndRfSection::drift(real_t *__restrict beam_dt,
+                                    const real_t *__restrict beam_dE,
                                     const solver_type solver,
                                     const double T0,
                                     const double length_ratio,
@@ -55,46 +346,169 @@ inline void RingAndRfSection::drift(double *__restrict beam_dt,
                                     const double energy,
                                     const int n_macroparticles)
 {
+    const drift_coefficients_t c = drift_coefficients(T0, length_ratio,
+                                   eta_zero, eta_one, eta_two, beta, energy);
+    const int order = drift_order(solver, alpha_order);
+
+    #pragma omp parallel
+    {
+        const int id = omp_get_thread_num();
+        const int threads = omp_get_num_threads();
+        const int chunk = simd_padded_size<real_t>(
+                              (n_macroparticles + threads - 1) / threads);
+        const int start = std::min(id * chunk, n_macroparticles);
+        const int end = std::min(start + chunk, n_macroparticles);
+
+        drift_particles(beam_dt, beam_dE, order, fast_reciprocal, c,
+                        start, end);
+    }
+}
 
-    const double T = T0 * length_ratio;
-
-    if (solver == simple) {
-        const double T_x_coeff = T * eta_zero / (beta * beta * energy);
-        #pragma omp parallel for
-        for (int i = 0; i < n_macroparticles; i++)
-            beam_dt[i] += T_x_coeff * beam_dE[i];
-    } else {
-        const double coeff = 1. / (beta * beta * energy);
-        const double eta0 = eta_zero * coeff;
-        const double eta1 = eta_one * coeff * coeff;
-        const double eta2 = eta_two * coeff * coeff * coeff;
-        if (alpha_order == 1) {
-            #pragma omp parallel for
-            for (int i = 0; i < n_macroparticles; i++)
-                beam_dt[i] += T * (1. / (1. - eta0 * beam_dE[i]) - 1.);
-        } else if (alpha_order == 2) {
-            #pragma omp parallel for
-            for (int i = 0; i < n_macroparticles; i++)
-                beam_dt[i] += T * (1. / (1. - eta0 * beam_dE[i] -
-                                         eta1 * beam_dE[i] * beam_dE[i]) -
-                                   1.);
-        } else {
-            #pragma omp parallel for
-            for (int i = 0; i < n_macroparticles; i++)
-                beam_dt[i] +=
-                    T * (1. / (1. - eta0 * beam_dE[i] -
-                               eta1 * beam_dE[i] * beam_dE[i] -
-                               eta2 * beam_dE[i] * beam_dE[i] * beam_dE[i]) -
-                         1.);
-        }
+// Kick and drift of one cache-sized block of particles at a time, the
+// same operations per particle as kick() followed by drift()
+template <typename real_t, typename kick_t>
+static void kick_drift_blocks(real_t *__restrict beam_dt,
+                              real_t *__restrict beam_dE,
+                              const kick_t &kick,
+                              const int order,
+                              const bool fast_reciprocal,
+                              const drift_coefficients_t &c,
+                              const int n_macroparticles)
+{
+    #pragma omp parallel for schedule(static)
+    for (int start = 0; start < n_macroparticles; start += FUSED_BLOCK_SIZE) {
+        const int end = std::min(start + FUSED_BLOCK_SIZE, n_macroparticles);
+        kick(beam_dt, beam_dE, start, end);
+        drift_particles(beam_dt, beam_dE, order, fast_reciprocal, c,
+                        start, end);
     }
 }
 
+template <typename real_t>
+inline void RingAndRfSection::kick_drift(real_t *__restrict beam_dt,
+        real_t *__restrict beam_dE,
+        const int n_rf,
+        const double *__restrict voltage,
+        const double *__restrict omega_rf,
+        const double *__restrict phi_rf,
+        const double acc_kick,
+        const solver_type solver,
+        const double T0,
+        const double length_ratio,
+        const int alpha_order,
+        const double eta_zero,
+        const double eta_one,
+        const double eta_two,
+        const double beta,
+        const double energy,
+        const int n_macroparticles)
+{
+    const drift_coefficients_t c = drift_coefficients(T0, length_ratio,
+                                   eta_zero, eta_one, eta_two, beta, energy);
+    const direct_kick_t kicker = {n_rf, voltage, omega_rf, phi_rf, acc_kick};
+    kick_drift_blocks(beam_dt, beam_dE, kicker,
+                      drift_order(solver, alpha_order), fast_reciprocal, c,
+                      n_macroparticles);
+}
 
 
-void RingAndRfSection::track()
+// Applies the kick, the drift and the histogram deposit to one cache-sized
+// block of particles at a time. Every operation is applied per particle in
+// the same order as kick(), drift() and Slices::histogram(), so the results
+// are identical to the unfused path. With thread_moments every block also
+// adds its moments after the drift, see Slices::histogram_statistics().
+template <typename real_t, typename kick_t>
+static void kick_drift_histogram_blocks(real_t *__restrict beam_dt,
+                                        real_t *__restrict beam_dE,
+                                        const int *__restrict beam_id,
+                                        bunch_moments_t *thread_moments,
+                                        const kick_t &kick,
+                                        const int order,
+                                        const bool fast_reciprocal,
+                                        const drift_coefficients_t &c,
+                                        int *__restrict thread_counts,
+                                        double *__restrict hist,
+                                        const double cut_left,
+                                        const double cut_right,
+                                        const int n_slices,
+                                        const int n_macroparticles)
 {
+    const double inv_bin_width = n_slices / (cut_right - cut_left);
+
+    int threads = 1;
+
+    #pragma omp parallel
+    {
+        const int id = omp_get_thread_num();
+        #pragma omp single nowait
+        threads = omp_get_num_threads();
+
+        int *h_row = &thread_counts[id * (n_slices + 1)];
+        memset(h_row, 0, (n_slices + 1) * sizeof(int));
+
+        #pragma omp for schedule(static)
+        for (int start = 0; start < n_macroparticles; start += FUSED_BLOCK_SIZE) {
+            const int end = std::min(start + FUSED_BLOCK_SIZE, n_macroparticles);
+
+            // KICK
+            kick(beam_dt, beam_dE, start, end);
+
+            // DRIFT
+            drift_particles(beam_dt, beam_dE, order, fast_reciprocal, c,
+                            start, end);
 
+            // HISTOGRAM
+            for (int i = start; i < end; ++i) {
+                if (beam_dt[i] < cut_left || beam_dt[i] > cut_right) continue;
+                h_row[(int)((beam_dt[i] - cut_left)*inv_bin_width)]++;
+            }
+
+            if (thread_moments)
+                thread_moments[id].add_block(beam_dt, beam_dE, beam_id,
+                                             start, end);
+        }
+    }
+
+    reduce_counts(thread_counts, hist, n_slices, threads);
+}
+
+template <typename real_t>
+inline void RingAndRfSection::kick_drift_histogram(real_t *__restrict beam_dt,
+        real_t *__restrict beam_dE,
+        const int n_rf,
+        const double *__restrict voltage,
+        const double *__restrict omega_rf,
+        const double *__restrict phi_rf,
+        const double acc_kick,
+        const solver_type solver,
+        const double T0,
+        const double length_ratio,
+        const int alpha_order,
+        const double eta_zero,
+        const double eta_one,
+        const double eta_two,
+        const double beta,
+        const double energy,
+        int *__restrict thread_counts,
+        double *__restrict hist,
+        const double cut_left,
+        const double cut_right,
+        const int n_slices,
+        const int n_macroparticles)
+{
+    const drift_coefficients_t c = drift_coefficients(T0, length_ratio,
+                                   eta_zero, eta_one, eta_two, beta, energy);
+    const direct_kick_t kicker = {n_rf, voltage, omega_rf, phi_rf, acc_kick};
+    kick_drift_histogram_blocks(beam_dt, beam_dE, (const int *) nullptr,
+                                (bunch_moments_t *) nullptr, kicker,
+                                drift_order(solver, alpha_order),
+                                fast_reciprocal, c, thread_counts, hist,
+                                cut_left, cut_right, n_slices,
+                                n_macroparticles);
+}
+
+void RingAndRfSection::apply_phi_noise()
+{
     if (!phi_noise.empty()) {
         if (noiseFB != NULL) {
             for (uint i = 0; i < phi_rf.size(); ++i)
@@ -105,76 +519,76 @@ void RingAndRfSection::track()
                 phi_rf[i][counter] += phi_noise[i][counter];
         }
     }
+}
+
+void RingAndRfSection::track()
+{
+
+    apply_phi_noise();
 
     // Determine phase loop correction on RF phase and frequency
     if (PL != NULL && counter >= (int) PL->delay)
         PL->track();
 
+    // The fused kernel deposits every particle to its nearest bin
+    const bool fused = fused_slicing && !periodicity && !rf_kick_interp
+                       && dE_max <= 0 && slices->deposit == Slices::ngp;
+
     if (periodicity) {
+        beam->require_double_precision("The periodicity option");
         // Change reference of all the particles on the right of the current
         // frame; these particles skip one kick and drift
         set_periodicity();
         const double tRev = t_rev[counter + 1];
 
+        // The gathered particles go through the member buffers, which
+        // keep their capacity from one turn to the next
         if (!indices_right_outside.empty()) {
-            f_vector_t insiders_dt, insiders_dE;
-            insiders_dt.reserve(indices_inside_frame.size());
-            insiders_dE.reserve(indices_inside_frame.size());
-            for (const auto &i : indices_inside_frame) {
-                insiders_dt.push_back(beam->dt[i]);
-                insiders_dE.push_back(beam->dE[i]);
-            }
+            gather(indices_inside_frame, 0., insiders_dt, insiders_dE);
 
-            for (const auto &i : indices_right_outside)
-                beam->dt[i] -= tRev;
+            const int n_right = indices_right_outside.size();
+            #pragma omp parallel for
+            for (int k = 0; k < n_right; ++k)
+                beam->dt[indices_right_outside[k]] -= tRev;
 
             // Synchronize the bunch with the particles that are on the right of
             // the current frame applying kick and drift to the bunch; after that
             // all the particle are in the new updated frame
             kick(insiders_dt, insiders_dE, counter);
             drift(insiders_dt, insiders_dE, counter + 1);
-            int k = 0;
-            for (const auto &i : indices_inside_frame) {
-                beam->dt[i] = insiders_dt[k];
-                beam->dE[i] = insiders_dE[k];
-                k++;
-            }
+            scatter(indices_inside_frame, insiders_dt, insiders_dE);
 
         } else {
             kick(beam->dt, beam->dE, counter);
             drift(beam->dt, beam->dE, counter + 1);
             // find left outside particles and kick, drift them one more time
-            // indices_left_outside.clear();
-            //#pragma omp parallel for reduction(+:a)
-            for (int i = 0; i < beam->n_macroparticles; ++i) {
-                if (beam->dt[i] < 0)
-                    indices_left_outside.push_back(i);
-            }
+            const double *__restrict dt = beam->dt.data();
+            int_vector_t *left[1] = {&indices_left_outside};
+            partition_indices<1>(beam->n_macroparticles,
+            [dt](const int i) { return dt[i] < 0 ? 0 : -1; }, left);
         }
 
         if (!indices_left_outside.empty()) {
-            f_vector_t left_dt, left_dE;
-            left_dt.reserve(indices_left_outside.size());
-            left_dE.reserve(indices_left_outside.size());
-            for (const auto &i : indices_left_outside) {
-                left_dt.push_back(beam->dt[i] + tRev);
-                left_dE.push_back(beam->dE[i]);
-            }
-
+            gather(indices_left_outside, tRev, left_dt, left_dE);
             kick(left_dt, left_dE, counter);
             drift(left_dt, left_dE, counter + 1);
-            int k = 0;
-            for (const auto &i : indices_left_outside) {
-                beam->dt[i] = left_dt[k];
-                beam->dE[i] = left_dE[k];
-                k++;
-            }
+            scatter(indices_left_outside, left_dt, left_dE);
         }
 
         // cout << "right: " << indices_right_outside.size() << '\n';
         // cout << "inside: " << indices_inside_frame.size() << '\n';
         // cout << "left: " << indices_left_outside.size() << '\n';
 
+    } else if (fused) {
+        // In the order of Slices::track(); the frame follows the statistics
+        // of the previous turn, which the fused pass has not updated yet
+        if (slices->adaptive_frame)
+            slices->track_frame();
+        kick_drift_histogram(counter);
+        if (slices->fit_option == Slices::fit_t::gaussian)
+            slices->gaussian_fit();
+        if (!slices->bunch_pattern.empty())
+            slices->slice_multibunch();
     } else {
         if (rf_kick_interp) {
             // TODO test this part
@@ -186,35 +600,59 @@ void RingAndRfSection::track()
 
             fRfVoltage *= charge;
 
-            linear_interp_kick(beam->dt.data(), beam->dE.data(),
-                               fRfVoltage.data(), slices->bin_centers.data(),
-                               slices->n_slices, beam->n_macroparticles);
+            linear_interp_kick(beam, fRfVoltage.data(),
+                               slices->bin_centers.data(), slices->n_slices);
+
+            if (beam->precision == ParticleStorage::single_precision)
+                drift(beam->dt_f, beam->dE_f, counter + 1);
+            else
+                drift(beam->dt, beam->dE, counter + 1);
+        } else if (beam->precision == ParticleStorage::single_precision) {
+            kick_drift(beam->dt_f, beam->dE_f, counter, beam->dt_reference);
         } else {
-            kick(beam->dt, beam->dE, counter);
+            kick_drift(beam->dt, beam->dE, counter);
         }
-        drift(beam->dt, beam->dE, counter + 1);
     }
 
     if (dE_max > 0) horizontal_cut();
 
+    // The fused kernel could not be used, slice the beam as usual
+    if (fused_slicing && !fused)
+        slices->track();
+
     counter++;
 }
 
 
-// TODO test this function
-inline void RingAndRfSection::horizontal_cut()
+// Moves the particles with dE > -dE_max to the front of the arrays, in
+// their original order, and returns how many they are
+template <typename real_t>
+static int compact_particles(real_t *__restrict dt, real_t *__restrict dE,
+                             int *__restrict id, const double dE_max,
+                             const int n_macroparticles)
 {
-    uint i = 0;
-    while (i < beam->dE.size()) {
-        if (beam->dE[i] > -dE_max) {
-            beam->dE.erase(beam->dE.begin() + i);
-            beam->dt.erase(beam->dt.begin() + i);
-            beam->id.erase(beam->id.begin() + i);
-        } else {
-            i++;
-        }
+    int k = 0;
+    for (int i = 0; i < n_macroparticles; ++i) {
+        if (dE[i] <= -dE_max) continue;
+        dt[k] = dt[i];
+        dE[k] = dE[i];
+        id[k] = id[i];
+        k++;
     }
-    beam->n_macroparticles = beam->dE.size();
+    return k;
+}
+
+inline void RingAndRfSection::horizontal_cut()
+{
+    int n;
+    if (beam->precision == ParticleStorage::single_precision)
+        n = compact_particles(beam->dt_f.data(), beam->dE_f.data(),
+                              beam->id.data(), dE_max, beam->size());
+    else
+        n = compact_particles(beam->dt.data(), beam->dE.data(),
+                              beam->id.data(), dE_max, beam->size());
+    beam->resize(n);
+    beam->n_macroparticles = n;
 }
 
 void RingAndRfSection::rf_voltage_calculation(int turn, Slices *slices)
@@ -222,74 +660,258 @@ void RingAndRfSection::rf_voltage_calculation(int turn, Slices *slices)
     // Calculating the RF voltage seen by the beam at a given turn,
     // needs a Slices object.
 
-    auto vol = new double[n_rf];
-    auto omeg = new double[n_rf];
-    auto phi = new double[n_rf];
+    load_rf_parameters(turn, 0.);
+    const double *vol = fVoltageBuffer.data();
+    const double *omeg = fOmegaBuffer.data();
+    const double *phi = fPhiBuffer.data();
+
+    const int n_slices = slices->bin_centers.size();
+    fRfVoltage.assign(n_slices, 0.0);
+    fPhaseBuffer.resize(n_slices);
+    double *phase = fPhaseBuffer.data();
+
+    for (int i = 0; i < n_rf; i++) {
+        for (int j = 0; j < n_slices; j++)
+            phase[j] = omeg[i] * slices->bin_centers[j] + phi[i];
+        fast_sin_v(phase, phase, n_slices);
+        for (int j = 0; j < n_slices; j++)
+            fRfVoltage[j] += vol[i] * phase[j];
+    }
+}
 
+// The RF parameters of one turn, gathered over the harmonics into the
+// buffers sized by the constructor, so kick() allocates nothing per turn
+void RingAndRfSection::load_rf_parameters(const int index,
+        const double dt_reference)
+{
     for (int i = 0; i < n_rf; ++i) {
-        vol[i] = voltage[i][turn];
-        omeg[i] = omega_rf[i][turn];
-        phi[i] = phi_rf[i][turn];
+        fVoltageBuffer[i] = voltage[i][index];
+        fOmegaBuffer[i] = omega_rf[i][index];
+        fPhiBuffer[i] = phi_rf[i][index] + fOmegaBuffer[i] * dt_reference;
     }
+}
 
-    fRfVoltage.resize(slices->bin_centers.size());
+void RingAndRfSection::set_tabulated_kick(const double max_error)
+{
+    tabulated_kick_error = max_error;
+    fKickTableKey.clear();
+    fKickTablePoints = 0;
+}
 
-    for (uint j = 0; j < slices->bin_centers.size(); j++) {
-        double sum = 0.0;
-        for (int i = 0; i < n_rf; i++) {
-            sum += vol[i] * sin(omeg[i] * slices->bin_centers[j] + phi[i]);
-        }
-        fRfVoltage[j] = sum;
+// Brings the table up to date with the RF parameters in the buffers of
+// load_rf_parameters() and tells whether the tabulated kick applies.
+// The voltage is tabulated over one period of the lowest harmonic, which
+// needs all the harmonics to be multiples of it. The error of the linear
+// interpolation is below h^2 / 8 max|V''| <= h^2 / 8 sum(V_i omega_i^2)
+// for a step h, which sets the number of points.
+bool RingAndRfSection::update_kick_table()
+{
+    if (tabulated_kick_error <= 0)
+        return false;
+
+    if ((int) fKickTableKey.size() == 3 * n_rf) {
+        bool same = true;
+        for (int i = 0; i < n_rf; ++i)
+            same &= fKickTableKey[3 * i] == fVoltageBuffer[i]
+                    && fKickTableKey[3 * i + 1] == fOmegaBuffer[i]
+                    && fKickTableKey[3 * i + 2] == fPhiBuffer[i];
+        if (same) return fKickTablePoints > 0;
     }
 
+    fKickTableKey.resize(3 * n_rf);
+    for (int i = 0; i < n_rf; ++i) {
+        fKickTableKey[3 * i] = fVoltageBuffer[i];
+        fKickTableKey[3 * i + 1] = fOmegaBuffer[i];
+        fKickTableKey[3 * i + 2] = fPhiBuffer[i];
+    }
 
-    delete[] vol;
-    delete[] omeg;
-    delete[] phi;
+    const double omega0 = *std::min_element(fOmegaBuffer.begin(),
+                                            fOmegaBuffer.end());
+    double curvature = 0.;
+    fKickTablePoints = 0;
+    for (int i = 0; i < n_rf; ++i) {
+        const double ratio = fOmegaBuffer[i] / omega0;
+        if (std::abs(ratio - std::round(ratio)) > 1e-9 * ratio)
+            return false;
+        curvature += std::abs(fVoltageBuffer[i])
+                     * fOmegaBuffer[i] * fOmegaBuffer[i];
+    }
+
+    const double period = 2 * constant::pi / omega0;
+    const double max_step = std::sqrt(8 * tabulated_kick_error / curvature);
+    const double points = std::max(16., std::ceil(period / max_step));
+    if (points > (1 << 24)) {
+        cerr << "ERROR: The tabulated kick needs " << points
+             << " points for an error of " << tabulated_kick_error
+             << ", the limit is " << (1 << 24) << "\n";
+        exit(-1);
+    }
+    const int n = points;
+    const double step = period / n;
+    fKickTablePoints = n;
+    fKickTableInvStep = n / period;
+
+    // values at the even entries first, then the slopes in between
+    fKickTable.assign(2 * (n + 1), 0.);
+    fPhaseBuffer.resize(n + 1);
+    double *phase = fPhaseBuffer.data();
+    for (int i = 0; i < n_rf; ++i) {
+        for (int k = 0; k <= n; ++k)
+            phase[k] = fOmegaBuffer[i] * (k * step) + fPhiBuffer[i];
+        fast_sin_v(phase, phase, n + 1);
+        for (int k = 0; k <= n; ++k)
+            fKickTable[2 * k] += fVoltageBuffer[i] * phase[k];
+    }
+    for (int k = 0; k < n; ++k)
+        fKickTable[2 * k + 1] = fKickTable[2 * k + 2] - fKickTable[2 * k];
+    return true;
 }
 
 
-void RingAndRfSection::set_periodicity()
+// Splits the indices [0, n) into the N lists of out, in increasing order;
+// class_of(i) gives the list of particle i or -1 to drop it. Every thread
+// counts its block of particles, an exclusive prefix sum of the counts
+// over the threads gives where each thread writes its indices.
+template <int N, typename F>
+void RingAndRfSection::partition_indices(const int n, F class_of,
+        int_vector_t *out[N])
 {
+    fPartitionOffsets.resize(N * omp_get_max_threads());
+    int *__restrict offsets = fPartitionOffsets.data();
+
+    #pragma omp parallel
+    {
+        const int id = omp_get_thread_num();
+        const int threads = omp_get_num_threads();
+        const int chunk = (n + threads - 1) / threads;
+        const int start = std::min(id * chunk, n);
+        const int end = std::min(start + chunk, n);
+
+        int count[N] = {0};
+        for (int i = start; i < end; ++i) {
+            const int c = class_of(i);
+            for (int k = 0; k < N; ++k)
+                count[k] += (c == k);
+        }
+        for (int k = 0; k < N; ++k)
+            offsets[id * N + k] = count[k];
+
+        #pragma omp barrier
+        #pragma omp single
+        {
+            for (int k = 0; k < N; ++k) {
+                int total = 0;
+                for (int t = 0; t < threads; ++t) {
+                    const int c = offsets[t * N + k];
+                    offsets[t * N + k] = total;
+                    total += c;
+                }
+                out[k]->resize(total);
+            }
+        }
 
-    indices_right_outside.clear();
-    indices_inside_frame.clear();
-    indices_left_outside.clear();
+        int *dst[N];
+        for (int k = 0; k < N; ++k)
+            dst[k] = out[k]->data() + offsets[id * N + k];
+        // compare against every k instead of indexing dst[c], so that the
+        // unrolled loop keeps the N write pointers in registers
+        for (int i = start; i < end; ++i) {
+            const int c = class_of(i);
+            for (int k = 0; k < N; ++k)
+                if (c == k) *dst[k]++ = i;
+        }
+    }
+}
+
+void RingAndRfSection::gather(const int_vector_t &indices, const double shift,
+                              f_vector_t &dt, f_vector_t &dE)
+{
+    const int n = indices.size();
+    dt.resize(n);
+    dE.resize(n);
+    #pragma omp parallel for
+    for (int k = 0; k < n; ++k) {
+        dt[k] = beam->dt[indices[k]] + shift;
+        dE[k] = beam->dE[indices[k]];
+    }
+}
+
+void RingAndRfSection::scatter(const int_vector_t &indices,
+                               const f_vector_t &dt, const f_vector_t &dE)
+{
+    const int n = indices.size();
+    #pragma omp parallel for
+    for (int k = 0; k < n; ++k) {
+        beam->dt[indices[k]] = dt[k];
+        beam->dE[indices[k]] = dE[k];
+    }
+}
+
+void RingAndRfSection::set_periodicity()
+{
     // TODO I am not duplicating the insiders dE, dt
     // as done in the python version
-    for (int i = 0; i < beam->n_macroparticles; ++i) {
-        if (beam->dt[i] > t_rev[counter + 1])
-            indices_right_outside.push_back(i);
-        else if (beam->dt[i] < t_rev[counter + 1])
-            indices_inside_frame.push_back(i);
-    }
+    const double *__restrict dt = beam->dt.data();
+    const double tRev = t_rev[counter + 1];
+    int_vector_t *parts[2] = {&indices_right_outside, &indices_inside_frame};
+    partition_indices<2>(beam->n_macroparticles,
+    [dt, tRev](const int i) {
+        return dt[i] > tRev ? 0 : (dt[i] < tRev ? 1 : -1);
+    }, parts);
+    indices_left_outside.clear();
 }
 
-void RingAndRfSection::kick(f_vector_t &beam_dt, f_vector_t &beam_dE,
-                            const int index)
+void RingAndRfSection::kick(span_t<const double> beam_dt,
+                            span_t<double> beam_dE, const int index)
 {
+    kick_span(beam_dt, beam_dE, index, 0.);
+}
 
-    auto vol = new double[n_rf];
-    auto omeg = new double[n_rf];
-    auto phi = new double[n_rf];
+void RingAndRfSection::kick(span_t<const float> beam_dt,
+                            span_t<float> beam_dE, const int index,
+                            const double dt_reference)
+{
+    kick_span(beam_dt, beam_dE, index, dt_reference);
+}
 
-    for (int i = 0; i < n_rf; ++i) {
-        vol[i] = voltage[i][index];
-        omeg[i] = omega_rf[i][index];
-        phi[i] = phi_rf[i][index];
+// The reference of the time coordinate is folded into the RF phases,
+// omega * (dt + dt_reference) + phi = omega * dt + (phi + omega * dt_reference)
+template <typename real_t>
+void RingAndRfSection::kick_span(span_t<const real_t> beam_dt,
+                                 span_t<real_t> beam_dE, const int index,
+                                 const double dt_reference)
+{
+    load_rf_parameters(index, dt_reference);
+    if (update_kick_table()) {
+        const tabulated_kick_t kicker = {fKickTable.data(), fKickTableInvStep,
+                                         fKickTablePoints,
+                                         acceleration_kick[index]
+                                        };
+        kick_chunks(beam_dt.data(), beam_dE.data(), kicker, beam_dt.size());
+        return;
     }
+    kick(beam_dt.data(), beam_dE.data(), n_rf, fVoltageBuffer.data(),
+         fOmegaBuffer.data(), fPhiBuffer.data(), beam_dt.size(),
+         acceleration_kick[index]);
+}
 
-    kick(beam_dt.data(), beam_dE.data(), n_rf, vol, omeg, phi,
-         beam_dt.size(), acceleration_kick[index]);
 
-    delete[] vol;
-    delete[] omeg;
-    delete[] phi;
+void RingAndRfSection::drift(span_t<double> beam_dt,
+                             span_t<const double> beam_dE, const int index)
+{
+    drift_span(beam_dt, beam_dE, index);
 }
 
+void RingAndRfSection::drift(span_t<float> beam_dt,
+                             span_t<const float> beam_dE, const int index)
+{
+    drift_span(beam_dt, beam_dE, index);
+}
 
-void RingAndRfSection::drift(f_vector_t &beam_dt, f_vector_t &beam_dE,
-                             const int index)
+template <typename real_t>
+void RingAndRfSection::drift_span(span_t<real_t> beam_dt,
+                                  span_t<const real_t> beam_dE,
+                                  const int index)
 {
 
     drift(beam_dt.data(), beam_dE.data(), solver, t_rev[index],
@@ -298,6 +920,224 @@ void RingAndRfSection::drift(f_vector_t &beam_dt, f_vector_t &beam_dE,
           rfp->energy[index], beam_dt.size());
 }
 
+void RingAndRfSection::kick_drift(span_t<double> beam_dt,
+                                  span_t<double> beam_dE, const int index)
+{
+    kick_drift_span(beam_dt, beam_dE, index, 0.);
+}
+
+void RingAndRfSection::kick_drift(span_t<float> beam_dt,
+                                  span_t<float> beam_dE, const int index,
+                                  const double dt_reference)
+{
+    kick_drift_span(beam_dt, beam_dE, index, dt_reference);
+}
+
+template <typename real_t>
+void RingAndRfSection::kick_drift_span(span_t<real_t> beam_dt,
+                                       span_t<real_t> beam_dE,
+                                       const int index,
+                                       const double dt_reference)
+{
+    load_rf_parameters(index, dt_reference);
+    if (update_kick_table()) {
+        const tabulated_kick_t kicker = {fKickTable.data(), fKickTableInvStep,
+                                         fKickTablePoints,
+                                         acceleration_kick[index]
+                                        };
+        const drift_coefficients_t c = drift_coefficients(t_rev[index + 1],
+                                       length_ratio, eta_0[index + 1],
+                                       eta_1[index + 1], eta_2[index + 1],
+                                       rfp->beta[index + 1],
+                                       rfp->energy[index + 1]);
+        kick_drift_blocks(beam_dt.data(), beam_dE.data(), kicker,
+                          drift_order(solver, alpha_order), fast_reciprocal,
+                          c, beam_dt.size());
+        return;
+    }
+    kick_drift(beam_dt.data(), beam_dE.data(), n_rf, fVoltageBuffer.data(),
+               fOmegaBuffer.data(), fPhiBuffer.data(),
+               acceleration_kick[index], solver, t_rev[index + 1],
+               length_ratio, alpha_order, eta_0[index + 1],
+               eta_1[index + 1], eta_2[index + 1], rfp->beta[index + 1],
+               rfp->energy[index + 1], beam_dt.size());
+}
+
+void RingAndRfSection::kick_drift_histogram(const int index)
+{
+    if (beam->precision == ParticleStorage::single_precision)
+        kick_drift_histogram(beam->dt_span<float>(), beam->dE_span<float>(),
+                             index, beam->dt_reference);
+    else
+        kick_drift_histogram(beam->dt_span<double>(), beam->dE_span<double>(),
+                             index, 0.);
+}
+
+template <typename real_t>
+void RingAndRfSection::kick_drift_histogram(span_t<real_t> beam_dt,
+        span_t<real_t> beam_dE,
+        const int index,
+        const double dt_reference)
+{
+    load_rf_parameters(index, dt_reference);
+    bunch_moments_t *thread_moments = beam->stream_statistics ?
+                                      slices->thread_moments.data() : nullptr;
+    if (update_kick_table()) {
+        const tabulated_kick_t kicker = {fKickTable.data(), fKickTableInvStep,
+                                         fKickTablePoints,
+                                         acceleration_kick[index]
+                                        };
+        const drift_coefficients_t c = drift_coefficients(t_rev[index + 1],
+                                       length_ratio, eta_0[index + 1],
+                                       eta_1[index + 1], eta_2[index + 1],
+                                       rfp->beta[index + 1],
+                                       rfp->energy[index + 1]);
+        kick_drift_histogram_blocks(beam_dt.data(), beam_dE.data(),
+                                    beam->id.data(), thread_moments, kicker,
+                                    drift_order(solver, alpha_order),
+                                    fast_reciprocal, c, slices->thread_counts.data(),
+                                    slices->n_macroparticles.data(),
+                                    slices->cut_left - dt_reference,
+                                    slices->cut_right - dt_reference,
+                                    slices->n_slices, beam_dt.size());
+    } else {
+        const drift_coefficients_t c = drift_coefficients(t_rev[index + 1],
+                                       length_ratio, eta_0[index + 1],
+                                       eta_1[index + 1], eta_2[index + 1],
+                                       rfp->beta[index + 1],
+                                       rfp->energy[index + 1]);
+        const direct_kick_t kicker = {n_rf, fVoltageBuffer.data(),
+                                      fOmegaBuffer.data(), fPhiBuffer.data(),
+                                      acceleration_kick[index]
+                                     };
+        kick_drift_histogram_blocks(beam_dt.data(), beam_dE.data(),
+                                    beam->id.data(), thread_moments, kicker,
+                                    drift_order(solver, alpha_order),
+                                    fast_reciprocal, c, slices->thread_counts.data(),
+                                    slices->n_macroparticles.data(),
+                                    slices->cut_left - dt_reference,
+                                    slices->cut_right - dt_reference,
+                                    slices->n_slices, beam_dt.size());
+    }
+    if (thread_moments)
+        slices->publish_statistics(dt_reference);
+}
+
+double RingAndRfSection::synchronous_dt(const int turn) const
+{
+    // Same centre as the distributions generated in the bucket
+    if (eta_0[turn] > 0)
+        return (phi_s[turn] - phi_rf[0][turn]) / omega_rf[0][turn];
+    else
+        return (phi_s[turn] - phi_rf[0][turn] - constant::pi)
+               / omega_rf[0][turn];
+}
+
+void RingAndRfSection::set_precision(
+    const ParticleStorage::precision_t precision)
+{
+    beam->set_precision(precision, synchronous_dt(counter));
+}
+
+RingAndRfSection::precision_report_t
+RingAndRfSection::validate_precision(const int n_turns)
+{
+    if (counter + n_turns >= (int) t_rev.size()) {
+        cerr << "ERROR: validate_precision needs " << n_turns
+             << " turns past turn " << counter << ", the RF parameters"
+             << " only cover " << t_rev.size() - 1 << " turns\n";
+        exit(-1);
+    }
+
+    Beams reference(*beam);
+    reference.set_precision(ParticleStorage::double_precision);
+    Beams single(reference);
+    single.set_precision(ParticleStorage::single_precision,
+                         synchronous_dt(counter));
+
+    for (int turn = counter; turn < counter + n_turns; ++turn) {
+        kick(reference.dt, reference.dE, turn);
+        drift(reference.dt, reference.dE, turn + 1);
+        kick(single.dt_f, single.dE_f, turn, single.dt_reference);
+        drift(single.dt_f, single.dE_f, turn + 1);
+    }
+
+    reference.statistics();
+    single.statistics();
+
+    precision_report_t report;
+    report.n_turns = n_turns;
+    report.mean_dt_error = single.mean_dt - reference.mean_dt;
+    report.mean_dE_error = single.mean_dE - reference.mean_dE;
+    report.sigma_dt_error = single.sigma_dt - reference.sigma_dt;
+    report.sigma_dE_error = single.sigma_dE - reference.sigma_dE;
+
+    single.set_precision(ParticleStorage::double_precision);
+    const int n = reference.size();
+    double max_dt = 0., max_dE = 0., sum_dt = 0., sum_dE = 0.;
+    #pragma omp parallel for reduction(max:max_dt, max_dE) reduction(+:sum_dt, sum_dE)
+    for (int i = 0; i < n; ++i) {
+        const double err_dt = std::abs(single.dt[i] - reference.dt[i]);
+        const double err_dE = std::abs(single.dE[i] - reference.dE[i]);
+        max_dt = std::max(max_dt, err_dt);
+        max_dE = std::max(max_dE, err_dE);
+        sum_dt += err_dt * err_dt;
+        sum_dE += err_dE * err_dE;
+    }
+    report.max_dt_error = max_dt;
+    report.max_dE_error = max_dE;
+    report.rms_dt_error = n > 0 ? std::sqrt(sum_dt / n) : 0.;
+    report.rms_dE_error = n > 0 ? std::sqrt(sum_dE / n) : 0.;
+
+    return report;
+}
+
+// Whether this turn of track() is the kick and drift of kick_drift(),
+// with no step that needs to see the whole beam
+bool RingAndRfSection::kick_drift_only() const
+{
+    return !periodicity && !rf_kick_interp && !fused_slicing && dE_max <= 0
+           && (PL == NULL || counter < (int) PL->delay);
+}
+
+void RingAndRfSection::prepare_kick_drift()
+{
+    apply_phi_noise();
+    const bool single = beam->precision == ParticleStorage::single_precision;
+    load_rf_parameters(counter, single ? beam->dt_reference : 0.);
+    fTabulatedTurn = update_kick_table();
+}
+
+// Kick and drift of the current turn for the particles in [start, end),
+// the same operations per particle as kick_drift()
+template <typename real_t>
+void RingAndRfSection::kick_drift_block(real_t *__restrict beam_dt,
+                                        real_t *__restrict beam_dE,
+                                        const int start, const int end) const
+{
+    const int index = counter;
+    if (fTabulatedTurn) {
+        const tabulated_kick_t kicker = {fKickTable.data(), fKickTableInvStep,
+                                         fKickTablePoints,
+                                         acceleration_kick[index]
+                                        };
+        kicker(beam_dt, beam_dE, start, end);
+    } else {
+        const direct_kick_t kicker = {n_rf, fVoltageBuffer.data(),
+                                      fOmegaBuffer.data(), fPhiBuffer.data(),
+                                      acceleration_kick[index]
+                                     };
+        kicker(beam_dt, beam_dE, start, end);
+    }
+    const drift_coefficients_t c = drift_coefficients(t_rev[index + 1],
+                                   length_ratio, eta_0[index + 1],
+                                   eta_1[index + 1], eta_2[index + 1],
+                                   rfp->beta[index + 1],
+                                   rfp->energy[index + 1]);
+    drift_particles(beam_dt, beam_dE, drift_order(solver, alpha_order),
+                    fast_reciprocal, c, start, end);
+}
+
 FullRingAndRf::FullRingAndRf(const vector<RingAndRfSection *> &RingList)
 {
     fRingList = RingList;
@@ -313,9 +1153,55 @@ FullRingAndRf::~FullRingAndRf() {}
 
 void FullRingAndRf::track()
 {
-    // Loops over all the RingAndRFSection.track methods.
-    for (auto &ring : fRingList)
-        ring->track();
+    // Loops over all the RingAndRFSection.track methods. Consecutive
+    // sections that only kick and drift the same beam are tracked together
+    // one block of particles at a time, so the beam is swept once for all
+    // of them instead of once per section.
+    const int n_sections = fRingList.size();
+    for (int first = 0; first < n_sections;) {
+        int last = first + 1;
+        if (fRingList[first]->kick_drift_only())
+            while (last < n_sections && fRingList[last]->kick_drift_only()
+                    && fRingList[last]->beam == fRingList[first]->beam)
+                last++;
+
+        if (last - first > 1)
+            track_blocks(first, last);
+        else
+            fRingList[first]->track();
+        first = last;
+    }
+}
+
+void FullRingAndRf::track_blocks(const int first, const int last)
+{
+    Beams *beam = fRingList[first]->beam;
+    for (int s = first; s < last; ++s)
+        fRingList[s]->prepare_kick_drift();
+
+    if (beam->precision == ParticleStorage::single_precision)
+        track_blocks(beam->dt_f.data(), beam->dE_f.data(), beam->dt_f.size(),
+                     first, last);
+    else
+        track_blocks(beam->dt.data(), beam->dE.data(), beam->dt.size(),
+                     first, last);
+
+    for (int s = first; s < last; ++s)
+        fRingList[s]->counter++;
+}
+
+template <typename real_t>
+void FullRingAndRf::track_blocks(real_t *__restrict beam_dt,
+                                 real_t *__restrict beam_dE,
+                                 const int n_macroparticles,
+                                 const int first, const int last)
+{
+    #pragma omp parallel for schedule(static)
+    for (int start = 0; start < n_macroparticles; start += FUSED_BLOCK_SIZE) {
+        const int end = std::min(start + FUSED_BLOCK_SIZE, n_macroparticles);
+        for (int s = first; s < last; ++s)
+            fRingList[s]->kick_drift_block(beam_dt, beam_dE, start, end);
+    }
 }
 
 void FullRingAndRf::potential_well_generation(const int turn,
@@ -373,15 +1259,15 @@ void FullRingAndRf::potential_well_generation(const int turn,
 
     f_vector_t time_array = linspace(first_dt, last_dt, n_points);
 
-    fTotalVoltage.resize(time_array.size());
+    fTotalVoltage.assign(time_array.size(), 0.0);
+    f_vector_t phase(time_array.size());
 
-    for (int i = 0; i < (int)time_array.size(); ++i) {
-        double sum = 0.0;
-        for (int j = 0; j < (int)voltages.size(); ++j) {
-            sum += voltages[j] * fast_sin(omega_rf[j] * time_array[i] +
-                                          phi_offsets[j]);
-        }
-        fTotalVoltage[i] = sum;
+    for (int j = 0; j < (int)voltages.size(); ++j) {
+        for (int i = 0; i < (int)time_array.size(); ++i)
+            phase[i] = omega_rf[j] * time_array[i] + phi_offsets[j];
+        fast_sin_v(phase.data(), phase.data(), phase.size());
+        for (int i = 0; i < (int)time_array.size(); ++i)
+            fTotalVoltage[i] += voltages[j] * phase[i];
     }
 
     const double eom_factor_potential = sign(slippage_factor) * charge
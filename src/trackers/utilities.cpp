@@ -18,8 +18,8 @@ using namespace std;
 int_vector_t blond::is_in_separatrix(const GeneralParameters *GP,
                                      const RfParameters *RfP,
                                      const Beams *Beam,
-                                     const f_vector_t &dt,
-                                     const f_vector_t &dE,
+                                     span_t<const double> dt,
+                                     span_t<const double> dE,
                                      f_vector_t total_voltage)
 {
     /*
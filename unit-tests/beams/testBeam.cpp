@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <blond/blond.h>
+#include <testing_utilities.h>
 using namespace std;
 
 class testBeam : public ::testing::Test {
@@ -170,6 +171,131 @@ TEST_F(testBeam, losses_energy_cut1)
     }
 }
 
+TEST_F(testBeam, storage_alignment)
+{
+    auto Beam = Context::Beam;
+
+    ASSERT_EQ(0u, (uintptr_t) Beam->dt.data() % PARTICLE_ALIGNMENT);
+    ASSERT_EQ(0u, (uintptr_t) Beam->dE.data() % PARTICLE_ALIGNMENT);
+    ASSERT_EQ(0u, (uintptr_t) Beam->id.data() % PARTICLE_ALIGNMENT);
+
+    Beam->resize(N_p + 3);
+    const int padded = simd_padded_size<double>(N_p + 3);
+    ASSERT_EQ(0, padded % (PARTICLE_ALIGNMENT / sizeof(double)));
+    for (int i = N_p + 3; i < padded; i++) {
+        ASSERT_EQ(0., Beam->dt.data()[i]);
+        ASSERT_EQ(0., Beam->dE.data()[i]);
+    }
+
+    Beam->set_precision(ParticleStorage::single_precision);
+    ASSERT_EQ(0u, (uintptr_t) Beam->dt_f.data() % PARTICLE_ALIGNMENT);
+    ASSERT_EQ(0u, (uintptr_t) Beam->dE_f.data() % PARTICLE_ALIGNMENT);
+    ASSERT_EQ(N_p + 3, Beam->dt_span<float>().size());
+    ASSERT_EQ(simd_padded_size<float>(N_p + 3),
+              Beam->dt_span<float>().padded_size());
+}
+
+TEST_F(testBeam, single_precision_statistics)
+{
+    auto GP = Context::GP;
+    auto Beam = Context::Beam;
+    auto RfP = Context::RfP;
+
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, 1, false);
+    const f_vector_t dt(Beam->dt.begin(), Beam->dt.end());
+    Beam->statistics();
+    const double mean_dt = Beam->mean_dt;
+    const double sigma_dE = Beam->sigma_dE;
+
+    Beam->set_precision(ParticleStorage::single_precision);
+    ASSERT_EQ(0u, Beam->dt.size());
+    ASSERT_EQ((uint) N_p, Beam->dt_f.size());
+    Beam->statistics();
+    ASSERT_NEAR(mean_dt, Beam->mean_dt, 1e-6 * std::fabs(mean_dt));
+    ASSERT_NEAR(sigma_dE, Beam->sigma_dE, 1e-6 * sigma_dE);
+
+    Beam->set_precision(ParticleStorage::double_precision);
+    ASSERT_EQ(0u, Beam->dt_f.size());
+    ASSERT_NEAR_LOOP(dt, Beam->dt, "dt", 1e-7);
+}
+
+
+TEST_F(testBeam, sort_by_dt1)
+{
+    auto GP = Context::GP;
+    auto Beam = Context::Beam;
+    auto RfP = Context::RfP;
+
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, 1, false);
+    for (int i = 0; i < N_p; i++)
+        Beam->id[i] = i;
+
+    for (int threads : {1, 4}) {
+        omp_set_num_threads(threads);
+
+        // dE and id follow dt
+        const f_vector_t dt(Beam->dt.begin(), Beam->dt.end());
+        const f_vector_t dE(Beam->dE.begin(), Beam->dE.end());
+        Beam->sort_by_dt();
+        ASSERT_TRUE(std::is_sorted(ALL(Beam->dt)));
+        for (int i = 0; i < N_p; i++) {
+            ASSERT_EQ(dt[Beam->id[i]], Beam->dt[i]);
+            ASSERT_EQ(dE[Beam->id[i]], Beam->dE[i]);
+        }
+
+        // Small moves, as in one turn, and the permutation restarts
+        for (int i = 0; i < N_p; i++) {
+            Beam->dt[i] += 1e-3 * tau_0 * std::sin(1e-3 * Beam->dE[i]);
+            Beam->id[i] = i;
+        }
+    }
+    omp_set_num_threads(1);
+}
+
+
+TEST_F(testBeam, sort_by_dt2)
+{
+    auto GP = Context::GP;
+    auto Beam = Context::Beam;
+    auto RfP = Context::RfP;
+
+    // A lost particle far away from the bunch, negative dt and ties
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, 1, false);
+    Beam->dt[N_p / 2] = 1e-3;
+    Beam->dt[N_p / 3] = -Beam->dt[N_p / 3];
+    Beam->dt[N_p / 4] = Beam->dt[N_p / 5];
+    Beam->dt[N_p / 6] = 0.;
+    for (int i = 0; i < N_p; i++)
+        Beam->id[i] = i;
+    const f_vector_t dt(Beam->dt.begin(), Beam->dt.end());
+    const f_vector_t dE(Beam->dE.begin(), Beam->dE.end());
+
+    for (int threads : {1, 4}) {
+        omp_set_num_threads(threads);
+
+        int_vector_t position(N_p);
+        for (int i = 0; i < N_p; i++)
+            position[Beam->id[i]] = i;
+        Beam->sort_by_dt();
+        ASSERT_TRUE(std::is_sorted(ALL(Beam->dt)));
+        ASSERT_EQ(1e-3, Beam->dt[N_p - 1]);
+        for (int i = 0; i < N_p; i++) {
+            ASSERT_EQ(dt[Beam->id[i]], Beam->dt[i]);
+            ASSERT_EQ(dE[Beam->id[i]], Beam->dE[i]);
+        }
+        // Equal dt keep their previous order
+        for (int i = 1; i < N_p; i++)
+            if (Beam->dt[i] == Beam->dt[i - 1])
+                ASSERT_LT(position[Beam->id[i - 1]], position[Beam->id[i]]);
+
+        // Unsort it again for the next thread count
+        std::reverse(ALL(Beam->dt));
+        std::reverse(ALL(Beam->dE));
+        std::reverse(ALL(Beam->id));
+    }
+    omp_set_num_threads(1);
+}
+
 
 
 class testBeam2 : public ::testing::Test {
@@ -1,4 +1,5 @@
 #include <blond/blond.h>
+#include <testing_utilities.h>
 #include <gtest/gtest.h>
 using namespace std;
 
@@ -299,6 +300,349 @@ TEST_F(testSlices, smooth_histogram2)
 }
 
 
+TEST_F(testSlices, smooth_histogram3)
+{
+    auto GP = Context::GP;
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, 1, false);
+
+    // The per-thread histograms are sized for the threads at construction
+    omp_set_num_threads(4);
+    auto slice = Slices(RfP, Beam, N_slices);
+    omp_set_num_threads(1);
+    slice.slice_constant_space_histogram_smooth();
+    auto serial = slice.n_macroparticles;
+
+    // Every particle at least half a bin inside the frame deposits one
+    const double half_bin = 0.5 * (slice.cut_right - slice.cut_left) / N_slices;
+    int inside = 0;
+    for (const auto &dt : Beam->dt)
+        inside += dt >= slice.cut_left + half_bin
+                  && dt <= slice.cut_right - half_bin;
+    ASSERT_NEAR(inside, mymath::sum(serial), 1e-9 * inside);
+
+    omp_set_num_threads(4);
+    slice.slice_constant_space_histogram_smooth();
+    ASSERT_NEAR_LOOP(serial, slice.n_macroparticles, "n_macroparticles",
+                     1e-12);
+}
+
+
+TEST_F(testSlices, smooth_histogram4)
+{
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+
+    // Particles on the inner edge of the first and last bins. Those that
+    // round past the center of their bin must not deposit outside the frame
+    omp_set_num_threads(4);
+    for (int n_slices = 7; n_slices < 128; n_slices += 3) {
+        auto slice = Slices(RfP, Beam, n_slices);
+        const double bin_width = (slice.cut_right - slice.cut_left) / n_slices;
+        const double lower = slice.cut_left + bin_width * 0.5;
+        const double upper = slice.cut_right - bin_width * 0.5;
+        for (int i = 0; i < N_p; i++)
+            Beam->dt[i] = i % 2 ? upper : lower;
+
+        slice.slice_constant_space_histogram_smooth();
+        ASSERT_NEAR(N_p, mymath::sum(slice.n_macroparticles), 1e-9 * N_p)
+                << "Testing failed with n_slices " << n_slices;
+        for (int i = 2; i < n_slices - 2; i++)
+            ASSERT_EQ(0., slice.n_macroparticles[i])
+                    << "Testing failed with n_slices " << n_slices;
+    }
+    omp_set_num_threads(1);
+}
+
+TEST_F(testSlices, spline_histogram1)
+{
+    auto GP = Context::GP;
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, 1, false);
+
+    const double cut_left = *min_element(ALL(Beam->dt)) - tau_0;
+    const double cut_right = *max_element(ALL(Beam->dt)) + tau_0;
+
+    for (auto deposit : {Slices::tsc, Slices::cubic}) {
+        omp_set_num_threads(4);
+        auto slice = Slices(RfP, Beam, N_slices, 0, cut_left, cut_right,
+                            Slices::s, Slices::normal, false, deposit);
+        omp_set_num_threads(1);
+        slice.track();
+        auto serial = slice.n_macroparticles;
+
+        // All the particles are far from the edges, none of their weight
+        // is dropped
+        ASSERT_NEAR(N_p, mymath::sum(serial), 1e-9 * N_p);
+
+        omp_set_num_threads(4);
+        slice.track();
+        ASSERT_NEAR_LOOP(serial, slice.n_macroparticles, "n_macroparticles",
+                         1e-12);
+        omp_set_num_threads(1);
+    }
+}
+
+
+TEST_F(testSlices, deposit_interp_kick1)
+{
+    auto GP = Context::GP;
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, 1, false);
+
+    f_vector_t voltage(N_slices);
+    for (int i = 0; i < N_slices; i++)
+        voltage[i] = std::sin(0.1 * i) + 0.01 * i;
+
+    for (auto deposit : {Slices::tsc, Slices::cubic}) {
+        auto slice = Slices(RfP, Beam, N_slices, 0, 0, 0, Slices::s,
+                            Slices::normal, false, deposit);
+        slice.track();
+
+        // Deposit and kick share the particle shape, so the total kick is
+        // the voltage weighted by the profile
+        std::fill(ALL(Beam->dE), 0.);
+        deposit_interp_kick(Beam, voltage.data(), &slice);
+        double weighted_voltage = 0.;
+        for (int i = 0; i < N_slices; i++)
+            weighted_voltage += voltage[i] * slice.n_macroparticles[i];
+        ASSERT_NEAR(weighted_voltage, mymath::sum(Beam->dE.data(), N_p),
+                    1e-12 * std::abs(weighted_voltage));
+    }
+}
+
+
+TEST_F(testSlices, deposit_interp_kick2)
+{
+    auto GP = Context::GP;
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, 1, false);
+
+    f_vector_t voltage(N_slices);
+    for (int i = 0; i < N_slices; i++)
+        voltage[i] = std::sin(0.1 * i) + 0.01 * i;
+    const double charge = 2.5;
+    auto scaled = voltage * charge;
+
+    for (auto deposit : {Slices::ngp, Slices::tsc, Slices::cubic}) {
+        auto slice = Slices(RfP, Beam, N_slices, 0, 0, 0, Slices::s,
+                            Slices::normal, false, deposit);
+        slice.track();
+
+        // Scaling the kick is scaling the voltage
+        std::fill(ALL(Beam->dE), 0.);
+        deposit_interp_kick(Beam, scaled.data(), &slice);
+        auto ref = Beam->dE;
+        std::fill(ALL(Beam->dE), 0.);
+        deposit_interp_kick(Beam, voltage.data(), &slice, charge);
+        ASSERT_NEAR_LOOP(ref, Beam->dE, "dE", 1e-12);
+    }
+}
+
+TEST_F(testSlices, histogram_statistics1)
+{
+    auto GP = Context::GP;
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, 1, false);
+    for (int i = 0; i < N_p; i += 7) Beam->id[i] = 0;
+
+    omp_set_num_threads(4);
+    auto slice = Slices(RfP, Beam, N_slices);
+    slice.track();
+    auto profile = slice.n_macroparticles;
+
+    Beam->stream_statistics = true;
+    slice.track();
+    Beam->stream_statistics = false;
+    ASSERT_NEAR_LOOP(profile, slice.n_macroparticles, "n_macroparticles",
+                     1e-12);
+
+    // Two pass reference over the alive particles
+    double n = 0, m_dt = 0, m_dE = 0, s_dt = 0, s_dE = 0;
+    for (int i = 0; i < N_p; i++) {
+        n += Beam->id[i];
+        m_dt += Beam->id[i] * Beam->dt[i];
+        m_dE += Beam->id[i] * Beam->dE[i];
+    }
+    m_dt /= n;
+    m_dE /= n;
+    for (int i = 0; i < N_p; i++) {
+        s_dt += Beam->id[i] * (Beam->dt[i] - m_dt) * (Beam->dt[i] - m_dt);
+        s_dE += Beam->id[i] * (Beam->dE[i] - m_dE) * (Beam->dE[i] - m_dE);
+    }
+    s_dt = std::sqrt(s_dt / n);
+    s_dE = std::sqrt(s_dE / n);
+
+    ASSERT_EQ(N_p - (int) n, Beam->n_macroparticles_lost);
+    ASSERT_NEAR(m_dt, Beam->mean_dt, 1e-12 * std::abs(m_dt));
+    ASSERT_NEAR(m_dE, Beam->mean_dE, 1e-9 * s_dE);
+    ASSERT_NEAR(s_dt, Beam->sigma_dt, 1e-12 * s_dt);
+    ASSERT_NEAR(s_dE, Beam->sigma_dE, 1e-12 * s_dE);
+    ASSERT_NEAR(constant::pi * s_dt * s_dE, Beam->epsn_rms_l,
+                1e-12 * Beam->epsn_rms_l);
+    omp_set_num_threads(1);
+}
+
+
+TEST_F(testSlices, histogram1)
+{
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    const int n_slices = 1000;
+    const int n = 20 * HISTOGRAM_SERIAL_SIZE;
+
+    ASSERT_EQ(1, histogram_copies(HISTOGRAM_SERIAL_SIZE - 1, 10, 4));
+    ASSERT_EQ(1, histogram_copies(n, 10, 1));
+    ASSERT_EQ(4, histogram_copies(n, n_slices, 4));
+    ASSERT_EQ(2, histogram_copies(n, n, 4));
+
+    omp_set_num_threads(4);
+    auto slice = Slices(RfP, Beam, n_slices, 0, 0., 1.);
+
+    // Particles out of the frame, on both edges and piled up in one bin
+    f_vector_t input(n);
+    for (int i = 0; i < n; i++)
+        input[i] = (i % 7 == 0) ? 0.5 : 1.2 * i / n - 0.1;
+    input[1] = 0.;
+    input[2] = 1.;
+
+    for (const int n_particles : {n, HISTOGRAM_SERIAL_SIZE / 2}) {
+        f_vector_t reference(n_slices, 0.);
+        for (int i = 0; i < n_particles; i++) {
+            if (input[i] < 0. || input[i] > 1.) continue;
+            reference[std::min((int)(input[i] * n_slices), n_slices - 1)] += 1.;
+        }
+
+        f_vector_t output(n_slices, -1.);
+        slice.histogram(input.data(), output.data(), 0., 1., n_slices,
+                        n_particles);
+        for (int i = 0; i < n_slices; i++)
+            ASSERT_EQ(reference[i], output[i]) << "bin " << i;
+    }
+    omp_set_num_threads(1);
+}
+
+
+TEST_F(testSlices, multibunch1)
+{
+    auto GP = Context::GP;
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    const double T_rf = 2 * constant::pi / RfP->omega_rf[0][0];
+    longitudinal_bigaussian(GP, RfP, Beam, T_rf / 16, 0, 1, false);
+
+    // The same bunch in four buckets
+    const int_vector_t pattern = {3, 10, 11, 40};
+    const int n_bunch = N_p / 4;
+    for (int b = 3; b >= 0; b--)
+        for (int i = 0; i < n_bunch; i++) {
+            Beam->dt[b * n_bunch + i] = Beam->dt[i] + pattern[b] * T_rf;
+            Beam->dE[b * n_bunch + i] = Beam->dE[i];
+        }
+
+    omp_set_num_threads(4);
+    auto slice = Slices(RfP, Beam, N_slices);
+    slice.set_bunch_pattern(pattern, 64);
+    slice.track();
+    slice.fwhm_multibunch();
+    slice.rms_multibunch();
+
+    // A single bunch frame over the first bucket
+    auto ref = Slices(RfP, Beam, 64, 0, slice.bunch_cut_left[0],
+                      slice.bunch_cut_left[0] + T_rf);
+    ref.track();
+    ref.fwhm();
+    ref.rms();
+
+    for (int b = 0; b < 4; b++) {
+        const double shift = (pattern[b] - pattern[0]) * T_rf;
+        const double *profile = &slice.bunch_profiles[b * 64];
+        ASSERT_NEAR(mymath::sum(ref.n_macroparticles),
+                    mymath::sum(profile, 64), 1e-9);
+        ASSERT_NEAR(ref.bl_rms, slice.bl_rms_bbb[b], 1e-3 * ref.bl_rms);
+        ASSERT_NEAR(ref.bp_rms + shift, slice.bp_rms_bbb[b],
+                    1e-3 * ref.bl_rms);
+        ASSERT_NEAR(ref.bl_fwhm, slice.bl_fwhm_bbb[b], 1e-2 * ref.bl_fwhm);
+        ASSERT_NEAR(ref.bp_fwhm + shift, slice.bp_fwhm_bbb[b],
+                    1e-2 * ref.bl_fwhm);
+    }
+    omp_set_num_threads(1);
+}
+
+
+TEST_F(testSlices, adaptive_frame1)
+{
+    auto GP = Context::GP;
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, 1, false);
+
+    auto slice = Slices(RfP, Beam, N_slices);
+    const double bin_width = slice.frame_bin_width;
+    slice.set_adaptive_frame(10, 16, 1000);
+
+    // The bunch shrinks to a third and grows back
+    for (double scale : {1. / 3, 3.}) {
+        Beam->statistics();
+        for (auto &dt : Beam->dt)
+            dt = Beam->mean_dt + scale * (dt - Beam->mean_dt);
+        Beam->statistics();
+        slice.track();
+
+        const int needed = std::ceil(10 * Beam->sigma_dt / bin_width);
+        ASSERT_GE(slice.n_slices, needed);
+        ASSERT_EQ(slice.n_slices,
+                  (int) mymath::next_regular(needed - 1));
+        ASSERT_NEAR(bin_width, slice.edges[1] - slice.edges[0],
+                    1e-9 * bin_width);
+        ASSERT_NEAR(Beam->mean_dt, 0.5 * (slice.cut_left + slice.cut_right),
+                    1e-9 * bin_width);
+        ASSERT_EQ((int) slice.n_macroparticles.size(), slice.n_slices);
+    }
+}
+
+
+TEST_F(testSlices, adaptive_frame2)
+{
+    auto GP = Context::GP;
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, 1, false);
+    // The statistics of a beam that no pass has measured yet
+    Beam->mean_dt = Beam->sigma_dt = 0;
+
+    auto slice = Slices(RfP, Beam, N_slices);
+    const double bin_width = slice.frame_bin_width;
+    slice.set_adaptive_frame(10, 16, 1000);
+
+    // The first turn, then a bunch moved by two rms lengths, neither with
+    // streamed statistics
+    for (int turn = 0; turn < 2; turn++) {
+        if (turn > 0) {
+            const double shift = 2 * Beam->sigma_dt;
+            for (auto &dt : Beam->dt)
+                dt += shift;
+        }
+        slice.track();
+        Beam->statistics();
+
+        ASSERT_NEAR(Beam->mean_dt, 0.5 * (slice.cut_left + slice.cut_right),
+                    1e-9 * bin_width);
+        ASSERT_GE(slice.n_slices, std::ceil(10 * Beam->sigma_dt / bin_width));
+        int inside = 0;
+        for (const auto dt : Beam->dt)
+            inside += dt >= slice.cut_left && dt < slice.cut_right;
+        ASSERT_GE(inside, 0.99 * N_p);
+        ASSERT_EQ(inside, std::accumulate(ALL(slice.n_macroparticles), 0));
+    }
+}
+
+
 TEST_F(testSlices, track1)
 {
     auto RfP = Context::RfP;
@@ -324,6 +668,57 @@ TEST_F(testSlices, track1)
 }
 
 
+TEST_F(testSlices, beam_spectrum1)
+{
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    auto slice = Slices(RfP, Beam, N_slices);
+    slice.track();
+
+    for (const int n : {256, 256, 64, 300}) {
+        // A different profile every call, the padding must stay zero
+        for (auto &p : slice.n_macroparticles) p += 1.;
+        slice.beam_spectrum_generation(n);
+
+        auto v = slice.n_macroparticles;
+        complex_vector_t ref;
+        fft::rfft(v, ref, n);
+        auto freq = fft::rfftfreq(n, slice.bin_centers[1] - slice.bin_centers[0]);
+
+        ASSERT_EQ(ref.size(), slice.fBeamSpectrum.size());
+        ASSERT_EQ(freq, slice.fBeamSpectrumFreq);
+        for (uint i = 0; i < ref.size(); i++) {
+            ASSERT_NEAR(ref[i].real(), slice.fBeamSpectrum[i].real(),
+                        1e-9 * N_p);
+            ASSERT_NEAR(ref[i].imag(), slice.fBeamSpectrum[i].imag(),
+                        1e-9 * N_p);
+        }
+    }
+}
+
+
+TEST_F(testSlices, beam_spectrum2)
+{
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    auto slice = new Slices(RfP, Beam, N_slices, 0, 0, 0, Slices::s,
+                            Slices::normal, false, Slices::tsc);
+    slice->track();
+    slice->beam_spectrum_generation(256);
+
+    // A copy has buffers and a plan of its own, and outlives the original
+    Slices copy(*slice);
+    ASSERT_NE(slice->thread_hist.data(), copy.thread_hist.data());
+    ASSERT_NE(slice->thread_counts.data(), copy.thread_counts.data());
+    const auto spectrum = slice->fBeamSpectrum;
+    delete slice;
+
+    copy.track();
+    copy.beam_spectrum_generation(256);
+    ASSERT_EQ_LOOP(spectrum, copy.fBeamSpectrum, "spectrum");
+}
+
+
 TEST_F(testSlices, beam_profile_derivative1)
 {
     auto RfP = Context::RfP;
@@ -435,6 +830,58 @@ TEST_F(testSlices, beam_profile_derivative3)
 
 }
 
+TEST_F(testSlices, beam_profile_derivative4)
+{
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    auto slice = Slices(RfP, Beam, N_slices);
+    slice.track();
+    const auto &p = slice.n_macroparticles;
+    const double h = slice.bin_centers[1] - slice.bin_centers[0];
+
+    f_vector_t x, gradient, diff, filter1d(N_slices);
+    slice.beam_profile_derivative(x, gradient, "gradient");
+    slice.beam_profile_derivative(x, diff, "diff");
+    slice.beam_profile_derivative(filter1d.data(), Slices::filter1d);
+    ASSERT_EQ(slice.bin_centers, x);
+    ASSERT_EQ(N_slices, gradient.size());
+    ASSERT_NEAR_LOOP(gradient, diff, "diff", 1e-12);
+
+    // Gaussian kernel of scipy.ndimage, normalised before the derivative
+    double norm = 0.;
+    for (int d = -4; d <= 4; d++) norm += std::exp(-0.5 * d * d);
+    for (int i = 0; i < N_slices; i++) {
+        const double ref = i == 0 ? (p[1] - p[0]) / h
+                           : i == N_slices - 1 ? (p[i] - p[i - 1]) / h
+                           : (p[i + 1] - p[i - 1]) / (2 * h);
+        ASSERT_NEAR(ref, gradient[i], 1e-12 * std::abs(ref) + 1e-300);
+
+        double f = 0.;
+        for (int d = -4; d <= 4; d++)
+            f += d * std::exp(-0.5 * d * d) / norm
+                 * p[(i + d + N_slices) % N_slices];
+        ASSERT_NEAR(f / h, filter1d[i], 1e-9 * std::abs(f / h) + 1e-6);
+    }
+
+    // A low-pass far above the bandwidth of a smooth profile keeps it, and
+    // its coefficients are designed once
+    for (int i = 0; i < N_slices; i++)
+        slice.n_macroparticles[i] = 1e3 * std::exp(-(i - 50.) * (i - 50.) / 200.);
+    const double nyq = 0.5 / h;
+    map<string, string> filter_option = {
+        {"pass_frequency", to_string(0.4 * nyq)},
+        {"stop_frequency", to_string(0.6 * nyq)},
+        {"gain_pass", "1"},
+        {"gain_stop", "60"}
+    };
+    auto profile = p;
+    const int order = slice.beam_profile_filter_chebyshev(filter_option);
+    ASSERT_GT(order, 0);
+    ASSERT_NEAR_LOOP(profile, p, "n_macroparticles", 1e-3);
+    ASSERT_EQ(order, slice.beam_profile_filter_chebyshev(filter_option));
+}
+
+
 TEST_F(testSlices, beam_profile_derivative_deathtest1)
 {
     auto RfP = Context::RfP;
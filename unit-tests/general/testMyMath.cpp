@@ -608,7 +608,151 @@ TEST(random_choice, test4)
     ASSERT_NEAR_LOOP(freq, f_vector_t(5, size / 5), "frequency", epsilon);
 }
 
+TEST(fast_sincos_v, tracking_range)
+{
+    // omega_rf * dt + phi over a full LHC turn (h = 35640), odd length
+    // on purpose so that every kernel also runs its tail
+    const int n = 1000003;
+    const double epsilon = 1e-10;
+    auto x = linspace(-2.3e5, 2.3e5, n);
+    f_vector_t s(n), c(n), s2(n);
+    const auto best = simd_isa();
+
+    for (int isa = scalar_isa; isa <= best; ++isa) {
+        set_simd_isa((simd_isa_t) isa);
+        fast_sincos_v(x.data(), s.data(), c.data(), n);
+        fast_sin_v(x.data(), s2.data(), n);
+        for (int i = 0; i < n; ++i) {
+            ASSERT_NEAR(s[i], std::sin(x[i]), epsilon)
+                    << "isa " << isa << ", x = " << x[i];
+            ASSERT_NEAR(c[i], std::cos(x[i]), epsilon)
+                    << "isa " << isa << ", x = " << x[i];
+            ASSERT_EQ(s[i], s2[i]) << "isa " << isa << ", x = " << x[i];
+        }
+    }
+    set_simd_isa(best);
+}
+
+TEST(fast_sincos_v, in_place)
+{
+    auto x = linspace(-10.0, 10.0, 13);
+    f_vector_t c(x.size()), s(x.size());
+    fast_sincos_v(x.data(), s.data(), c.data(), x.size());
+    fast_cos_v(x.data(), x.data(), x.size());
+    ASSERT_DOUBLE_EQ_LOOP(c, x, "cos");
+}
+
+TEST(fast_exp_v, full_range)
+{
+    const int n = 100003;
+    auto x = linspace(-700.0, 700.0, n);
+    f_vector_t y(n);
+    const auto best = simd_isa();
+
+    for (int isa = scalar_isa; isa <= best; ++isa) {
+        set_simd_isa((simd_isa_t) isa);
+        fast_exp_v(x.data(), y.data(), n);
+        for (int i = 0; i < n; ++i)
+            ASSERT_NEAR(y[i] / std::exp(x[i]), 1.0, 1e-13)
+                    << "isa " << isa << ", x = " << x[i];
+
+        double lim[3] = { -800., 0., 800.};
+        fast_exp_v(lim, lim, 3);
+        ASSERT_EQ(lim[0], 0.);
+        ASSERT_EQ(lim[1], 1.);
+        ASSERT_EQ(lim[2], std::numeric_limits<double>::infinity());
+    }
+    set_simd_isa(best);
+}
+
+TEST(gaussian_fit, profile)
+{
+    // A bunch profile in seconds, fitted from a start 30% off
+    const int n = 100;
+    const double A = 5e3, x0 = 1.25e-9, sx = 1e-10;
+    auto x = linspace(0.8e-9, 1.7e-9, n);
+    f_vector_t y(n), noisy(n);
+    for (int i = 0; i < n; ++i) {
+        y[i] = A * std::exp(-(x[i] - x0) * (x[i] - x0) / (2 * sx * sx));
+        noisy[i] = y[i] + 50. * std::sin(7.3 * i);
+    }
+
+    double p[3] = {0.7 * A, x0 + 0.3 * sx, 1.3 * sx};
+    ASSERT_TRUE(gaussian_fit(x.data(), y.data(), n, p));
+    ASSERT_NEAR(p[0], A, 1e-10 * A);
+    ASSERT_NEAR(p[1], x0, 1e-10 * sx);
+    ASSERT_NEAR(std::abs(p[2]), sx, 1e-10 * sx);
+
+    // With noise the fit is a minimum of the sum of squares
+    auto chi2 = [&](const double q[3]) {
+        double c = 0.;
+        for (int i = 0; i < n; ++i) {
+            const double d = (x[i] - q[1]) / q[2];
+            const double r = noisy[i] - q[0] * std::exp(-0.5 * d * d);
+            c += r * r;
+        }
+        return c;
+    };
+    ASSERT_TRUE(gaussian_fit(x.data(), noisy.data(), n, p));
+    const double best = chi2(p);
+    const double delta[3] = {1e-4 * A, 1e-4 * sx, 1e-4 * sx};
+    for (int k = 0; k < 3; ++k)
+        for (int sign : { -1, 1}) {
+            double q[3] = {p[0], p[1], p[2]};
+            q[k] += sign * delta[k];
+            ASSERT_GE(chi2(q), best) << "parameter " << k;
+        }
+}
+
+
+TEST(chebyshev, filtfilt)
+{
+    const double wp = 0.2, ws = 0.3, gpass = 3., gstop = 60.;
+    double wn;
+    const int order = cheb2ord(wp, ws, gpass, gstop, wn);
+    ASSERT_EQ(8, order);
+    ASSERT_GT(wn, wp);
+    ASSERT_LT(wn, ws);
+
+    f_vector_t b, a, zi;
+    cheby2(order, gstop, wn, b, a);
+    ASSERT_EQ(order + 1, b.size());
+    ASSERT_EQ(1., a[0]);
 
+    // Unit gain at DC, the specification met on both bands
+    const int n = 1000;
+    f_vector_t w(n);
+    complex_vector_t h(n);
+    freqz(b, a, n, w.data(), h.data());
+    ASSERT_NEAR(1., std::abs(h[0]), 1e-9);
+    for (int k = 0; k < n; ++k) {
+        if (w[k] <= wp * M_PI) {
+            ASSERT_GE(std::abs(h[k]), std::pow(10., -gpass / 20.) - 1e-9);
+        }
+        if (w[k] >= ws * M_PI) {
+            ASSERT_LE(std::abs(h[k]), std::pow(10., -gstop / 20.) + 1e-9);
+        }
+    }
+
+    // A step is a steady state. Away from the edge transients a low tone
+    // passes with the gain squared and no delay, a high tone is
+    // attenuated twice.
+    lfilter_zi(b, a, zi);
+    const int len = 2000;
+    f_vector_t x(len), y(len), work;
+    std::fill(x.begin(), x.end(), 2.5);
+    filtfilt(b, a, zi, x.data(), y.data(), len, work);
+    for (int i = 0; i < len; ++i) ASSERT_NEAR(2.5, y[i], 1e-9);
+
+    const int k_low = 20, k_high = 350;
+    for (int i = 0; i < len; ++i)
+        x[i] = std::sin(w[k_low] * i) + std::sin(w[k_high] * i);
+    filtfilt(b, a, zi, x.data(), x.data(), len, work);
+    const double gain = std::norm(h[k_low]);
+    const double residual = std::pow(10., -gstop / 10.) + 1e-9;
+    for (int i = len / 4; i < 3 * len / 4; ++i)
+        ASSERT_NEAR(gain * std::sin(w[k_low] * i), x[i], residual);
+}
 
 
 
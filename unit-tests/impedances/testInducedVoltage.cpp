@@ -1,4 +1,5 @@
 #include <blond/blond.h>
+#include <testing_utilities.h>
 #include <gtest/gtest.h>
 
 using namespace std;
@@ -322,6 +323,49 @@ TEST_F(testInducedVoltage, convolution1)
 }
 
 
+TEST_F(testInducedVoltage, convolution2)
+{
+    auto slices = Context::Slice;
+    auto beam = Context::Beam;
+
+    slices->track();
+    auto epsilon = 1e-8;
+
+    InducedVoltageTime direct(slices, {resonator},
+                              InducedVoltageTime::time_domain);
+    InducedVoltageTime fourier(slices, {resonator},
+                               InducedVoltageTime::freq_domain);
+    InducedVoltageTime automatic(slices, {resonator},
+                                 InducedVoltageTime::automatic);
+    ASSERT_FALSE(direct.use_fft(slices->n_slices));
+    ASSERT_TRUE(fourier.use_fft(slices->n_slices));
+
+    // The voltage is negative, so the tolerance is relative to its
+    // largest magnitude
+    auto compare = [epsilon](const f_vector_t & ref, const f_vector_t & real) {
+        ASSERT_EQ(ref.size(), real.size());
+        double max = 0;
+        for (const auto &v : ref) max = std::max(max, std::abs(v));
+        for (uint i = 0; i < ref.size(); ++i)
+            ASSERT_NEAR(ref[i], real[i], epsilon * max)
+                    << "Testing of the induced voltage failed on i " << i
+                    << std::endl;
+    };
+
+    // Shorter and longer than the frame, and past the linear convolution
+    for (int length : {0, 100, 300, 3 * slices->n_slices}) {
+        auto a = direct.induced_voltage_generation(beam, length);
+        auto b = fourier.induced_voltage_generation(beam, length);
+        auto c = automatic.induced_voltage_generation(beam, length);
+        ASSERT_EQ(length, (int) a.size());
+        compare(a, b);
+        compare(a, c);
+        compare(direct.fInducedVoltage, fourier.fInducedVoltage);
+        compare(direct.fInducedVoltage, automatic.fInducedVoltage);
+    }
+}
+
+
 
 TEST_F(testInducedVoltage, track1)
 {
@@ -352,6 +396,150 @@ TEST_F(testInducedVoltage, track1)
 }
 
 
+TEST_F(testInducedVoltage, adaptive_frame1)
+{
+    auto slices = Context::Slice;
+    auto beam = Context::Beam;
+    auto RfP = Context::RfP;
+    const double center = 0.5 * (slices->cut_left + slices->cut_right);
+
+    slices->track();
+    InducedVoltageFreq indVoltFreq(slices, {resonator});
+    InducedVoltageTime indVoltTime(slices, {resonator});
+    indVoltFreq.induced_voltage_generation(beam);
+    indVoltTime.induced_voltage_generation(beam);
+    auto firstFreq = indVoltFreq.fInducedVoltage;
+    auto firstTime = indVoltTime.fInducedVoltage;
+
+    // A larger frame of the same bin width, against tables processed for it
+    slices->resize_frame(320, center);
+    slices->track();
+    indVoltFreq.induced_voltage_generation(beam);
+    indVoltTime.induced_voltage_generation(beam);
+
+    Slices fresh(RfP, beam, 320, 0, slices->cut_left, slices->cut_right);
+    fresh.track();
+    InducedVoltageFreq freshFreq(&fresh, {resonator});
+    InducedVoltageTime freshTime(&fresh, {resonator});
+    freshFreq.induced_voltage_generation(beam);
+    freshTime.induced_voltage_generation(beam);
+    ASSERT_NEAR_LOOP(freshFreq.fInducedVoltage, indVoltFreq.fInducedVoltage,
+                     "freq induced voltage", 1e-10);
+    ASSERT_NEAR_LOOP(freshTime.fInducedVoltage, indVoltTime.fInducedVoltage,
+                     "time induced voltage", 1e-10);
+
+    // Back to the first frame, from the cache
+    slices->resize_frame(N_slices, center);
+    slices->track();
+    indVoltFreq.induced_voltage_generation(beam);
+    indVoltTime.induced_voltage_generation(beam);
+    ASSERT_EQ(2u, indVoltFreq.fFrameCache.size());
+    ASSERT_EQ(2u, indVoltTime.fWakeCache.size());
+    ASSERT_NEAR_LOOP(firstFreq, indVoltFreq.fInducedVoltage,
+                     "freq induced voltage", 1e-12);
+    ASSERT_NEAR_LOOP(firstTime, indVoltTime.fInducedVoltage,
+                     "time induced voltage", 1e-12);
+}
+
+
+TEST_F(testInducedVoltage, individual_voltages1)
+{
+    auto slices = Context::Slice;
+    auto beam = Context::Beam;
+
+    slices->track();
+    auto epsilon = 1e-8;
+    // The sources are split between the threads
+    omp_set_num_threads(4);
+
+    // Two sources, each one a part of the resonators of the table
+    const int half = resonator->fNResonators / 2;
+    f_vector_t rs1(resonator->fRS.begin(), resonator->fRS.begin() + half);
+    f_vector_t fr1(resonator->fFrequencyR.begin(),
+                   resonator->fFrequencyR.begin() + half);
+    f_vector_t q1(resonator->fQ.begin(), resonator->fQ.begin() + half);
+    f_vector_t rs2(resonator->fRS.begin() + half, resonator->fRS.end());
+    f_vector_t fr2(resonator->fFrequencyR.begin() + half,
+                   resonator->fFrequencyR.end());
+    f_vector_t q2(resonator->fQ.begin() + half, resonator->fQ.end());
+    Resonators first(rs1, fr1, q1), second(rs2, fr2, q2);
+
+    InducedVoltageFreq both(slices, {&first, &second}, 0,
+                            InducedVoltageFreq::round_option, 0, false, true);
+    both.induced_voltage_generation(beam);
+
+    // The voltage of every source alone
+    std::vector<Intensity *> sources = {&first, &second};
+    for (uint i = 0; i < sources.size(); ++i) {
+        InducedVoltageFreq alone(slices, {sources[i]});
+        alone.induced_voltage_generation(beam);
+
+        f_vector_t real(slices->n_slices);
+        for (int j = 0; j < slices->n_slices; ++j)
+            real[j] = both.fMatrixSaveIndividualVoltages[i * slices->n_slices + j];
+
+        double max = 0;
+        for (const auto &v : alone.fInducedVoltage)
+            max = std::max(max, std::abs(v));
+        for (int j = 0; j < slices->n_slices; ++j)
+            ASSERT_NEAR(alone.fInducedVoltage[j], real[j], epsilon * max)
+                    << "Testing of fMatrixSaveIndividualVoltages failed on "
+                    << "source " << i << " and i " << j << std::endl;
+    }
+
+    // Their sum is the voltage of the two together
+    InducedVoltageFreq total(slices, {&first, &second});
+    total.induced_voltage_generation(beam);
+    ASSERT_EQ(total.fInducedVoltage.size(), both.fInducedVoltage.size());
+    double max = 0;
+    for (const auto &v : total.fInducedVoltage)
+        max = std::max(max, std::abs(v));
+    for (int j = 0; j < slices->n_slices; ++j)
+        ASSERT_NEAR(total.fInducedVoltage[j], both.fInducedVoltage[j],
+                    epsilon * max)
+                << "Testing of fInducedVoltage failed on i " << j << std::endl;
+}
+
+
+TEST_F(testInducedVoltage, copy1)
+{
+    auto slices = Context::Slice;
+    auto beam = Context::Beam;
+    slices->track();
+
+    // A copy has a plan of its own and outlives the original
+    auto indVoltFreq = new InducedVoltageFreq(slices, {resonator});
+    indVoltFreq->induced_voltage_generation(beam);
+    const auto voltage = indVoltFreq->fInducedVoltage;
+    InducedVoltageFreq copy(*indVoltFreq);
+    delete indVoltFreq;
+
+    copy.fInducedVoltage.assign(voltage.size(), 0.);
+    copy.induced_voltage_generation(beam);
+    ASSERT_EQ_LOOP(voltage, copy.fInducedVoltage, "fInducedVoltage");
+}
+
+
+TEST_F(testInducedVoltage, copy2)
+{
+    auto slices = Context::Slice;
+    auto beam = Context::Beam;
+    slices->track();
+
+    // The FFT convolution of a copy runs on plans of its own
+    auto indVoltTime = new InducedVoltageTime(slices, {resonator},
+            InducedVoltageTime::freq_domain);
+    indVoltTime->induced_voltage_generation(beam);
+    const auto voltage = indVoltTime->fInducedVoltage;
+    InducedVoltageTime copy(*indVoltTime);
+    delete indVoltTime;
+
+    copy.fInducedVoltage.assign(voltage.size(), 0.);
+    copy.induced_voltage_generation(beam);
+    ASSERT_EQ_LOOP(voltage, copy.fInducedVoltage, "fInducedVoltage");
+}
+
+
 TEST_F(testTotalInducedVoltage, sum1)
 {
     auto slices = Context::Slice;
@@ -529,6 +717,133 @@ TEST_F(testTotalInducedVoltage, track2)
     delete totVol;
 }
 
+TEST_F(testTotalInducedVoltage, track_memory1)
+{
+    auto slices = Context::Slice;
+    auto beam = Context::Beam;
+    const int n = slices->n_slices;
+    const int turns = 3;
+
+    auto epsilon = 1e-8;
+    auto indVoltFreq = new InducedVoltageFreq(slices, {resonator}, 1e5,
+            InducedVoltageFreq::round_option, 2);
+    // One frame per turn, the wake of a turn starts where the frame ends
+    const double revTime = slices->edges.back() - slices->edges.front();
+    auto totVol = new TotalInducedVoltage(beam, slices, {indVoltFreq}, 2,
+                                          f_vector_t(turns, revTime));
+
+    // The kicks leave dt and so the profile as they are, so every turn
+    // adds the wake of the same profile one revolution further back
+    slices->track();
+    f_vector_t profile(slices->n_macroparticles.begin(),
+                       slices->n_macroparticles.end());
+    complex_vector_t spectrum;
+    fft::rfft(profile, spectrum, totVol->fNPointsFFT);
+    spectrum *= totVol->fSumImpedancesMemory;
+    f_vector_t wake;
+    fft::irfft(spectrum, wake, totVol->fNPointsFFT);
+    const double coefficient = -beam->charge * constant::e * beam->ratio
+                               / (slices->bin_centers[1] - slices->bin_centers[0]);
+
+    f_vector_t ref(n, 0.);
+    for (int turn = 0; turn < turns; ++turn) {
+        totVol->track(beam);
+        for (int i = 0; i < n; ++i)
+            ref[i] += coefficient * wake[i + turn * n];
+        ASSERT_EQ(n, (int) totVol->fInducedVoltage.size());
+        ASSERT_NEAR_LOOP(ref, totVol->fInducedVoltage,
+                         "fInducedVoltage", epsilon);
+    }
+    ASSERT_EQ(turns, totVol->fCounterTurn);
+
+    delete indVoltFreq;
+    delete totVol;
+}
+
+TEST_F(testTotalInducedVoltage, track_memory2)
+{
+    auto slices = Context::Slice;
+    auto beam = Context::Beam;
+    const int turns = 3;
+
+    auto indVoltFreq = new InducedVoltageFreq(slices, {resonator}, 1e5,
+            InducedVoltageFreq::round_option, 2);
+    const double revTime = slices->edges.back() - slices->edges.front();
+    slices->track();
+
+    // The beam passed to track() is kicked, not the one of the constructor
+    auto original = *beam;
+    auto tracked = *beam;
+    auto reference = *beam;
+    auto totVol = new TotalInducedVoltage(beam, slices, {indVoltFreq}, 2,
+                                          f_vector_t(turns, revTime));
+    auto refVol = new TotalInducedVoltage(&reference, slices, {indVoltFreq},
+                                          2, f_vector_t(turns, revTime));
+    for (int turn = 0; turn < turns; ++turn) {
+        totVol->track(&tracked);
+        refVol->track(&reference);
+    }
+    ASSERT_EQ_LOOP(reference.dE, tracked.dE, "dE");
+    ASSERT_EQ_LOOP(original.dE, beam->dE, "dE");
+
+    delete totVol;
+    delete refVol;
+    delete indVoltFreq;
+}
+
+TEST_F(testTotalInducedVoltage, track_memory3)
+{
+    auto slices = Context::Slice;
+    auto beam = Context::Beam;
+
+    auto indVoltFreq = new InducedVoltageFreq(slices, {resonator}, 1e5,
+            InducedVoltageFreq::round_option, 2);
+    const double revTime = slices->edges.back() - slices->edges.front();
+    slices->track();
+
+    // A copy carries the memory on with plans of its own, and outlives the
+    // original
+    auto reference = *beam;
+    auto totVol = new TotalInducedVoltage(&reference, slices, {indVoltFreq},
+                                          2, f_vector_t(3, revTime));
+    totVol->track(&reference);
+    auto copied = reference;
+    auto copyVol = new TotalInducedVoltage(*totVol);
+    totVol->track(&reference);
+    copyVol->track(&copied);
+    ASSERT_EQ_LOOP(reference.dE, copied.dE, "dE");
+    ASSERT_EQ_LOOP(totVol->fArrayMemory, copyVol->fArrayMemory, "memory");
+
+    delete totVol;
+    copyVol->track(&copied);
+    ASSERT_EQ(3, copyVol->fCounterTurn);
+
+    delete copyVol;
+    delete indVoltFreq;
+}
+
+TEST_F(testTotalInducedVoltage, track_memory_deathtest1)
+{
+    auto slices = Context::Slice;
+    auto beam = Context::Beam;
+
+    auto indVoltFreq = new InducedVoltageFreq(slices, {resonator}, 1e5,
+            InducedVoltageFreq::round_option, 2);
+    const double revTime = slices->edges.back() - slices->edges.front();
+    auto totVol = new TotalInducedVoltage(beam, slices, {indVoltFreq}, 2,
+                                          f_vector_t(3, revTime));
+
+    // The memory window is fixed at construction
+    slices->set_adaptive_frame(4, 8, 64);
+    ASSERT_DEATH(totVol->track(beam), "\\[TotalInducedVoltage\\]\\s*");
+    ASSERT_DEATH(new TotalInducedVoltage(beam, slices, {indVoltFreq}, 2,
+                                         f_vector_t(3, revTime)),
+                 "\\[TotalInducedVoltage\\]\\s*");
+
+    delete totVol;
+    delete indVoltFreq;
+}
+
 
 int main(int ac, char *av[])
 {
@@ -445,6 +445,44 @@ TEST_F(testMonitors, BunchMonitor3)
     remove(filename);
 }
 
+TEST_F(testMonitors, BunchMonitor4)
+{
+    auto GP = Context::GP;
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    auto filename = "bunch.h5";
+    remove(filename);
+
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, -1, false);
+    auto slice = Slices(RfP, Beam, N_slices);
+    auto bunchmonitor = BunchMonitor(GP, RfP, Beam, filename, 100, &slice,
+                                     NULL, NULL, 9, true);
+    auto tracker = RingAndRfSection();
+
+    // The ngp turns stream the statistics, the turns of the other deposits
+    // must not leave the values of the last ngp turn
+    for (auto deposit : {Slices::ngp, Slices::tsc, Slices::linear,
+                         Slices::ngp, Slices::cubic
+                        }) {
+        slice.deposit = deposit;
+        for (int i = 0; i < 10; i++) {
+            tracker.track();
+            slice.track();
+            bunchmonitor.track();
+
+            const double mean_dt = Beam->mean_dt;
+            const double sigma_dt = Beam->sigma_dt;
+            const double sigma_dE = Beam->sigma_dE;
+            Beam->statistics();
+            ASSERT_NEAR(Beam->mean_dt, mean_dt, 1e-12 * fabs(Beam->mean_dt));
+            ASSERT_NEAR(Beam->sigma_dt, sigma_dt, 1e-12 * fabs(Beam->sigma_dt));
+            ASSERT_NEAR(Beam->sigma_dE, sigma_dE, 1e-12 * fabs(Beam->sigma_dE));
+        }
+    }
+    bunchmonitor.close();
+    remove(filename);
+}
+
 int main(int ac, char *av[])
 {
     ::testing::InitGoogleTest(&ac, av);
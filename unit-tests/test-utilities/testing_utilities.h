@@ -14,8 +14,12 @@
 #include <string>
 #include <cmath>
 
-static inline void ASSERT_NEAR_LOOP(const std::vector<double> &refV,
-                                    const std::vector<double> &realV,
+// The allocator parameters let the particle coordinates of a Beams object
+// (aligned_vector_t) be compared against plain std::vectors
+template <typename A1 = std::allocator<double>,
+          typename A2 = std::allocator<double>>
+static inline void ASSERT_NEAR_LOOP(const std::vector<double, A1> &refV,
+                                    const std::vector<double, A2> &realV,
                                     const std::string &varName,
                                     const double epsilon = 1e-8)
 {
@@ -31,8 +35,10 @@ static inline void ASSERT_NEAR_LOOP(const std::vector<double> &refV,
 }
 
 
-static inline void ASSERT_DOUBLE_EQ_LOOP(const std::vector<double> &refV,
-        const std::vector<double> &realV,
+template <typename A1 = std::allocator<double>,
+          typename A2 = std::allocator<double>>
+static inline void ASSERT_DOUBLE_EQ_LOOP(const std::vector<double, A1> &refV,
+        const std::vector<double, A2> &realV,
         const std::string &varName)
 {
     ASSERT_EQ(refV.size(), realV.size());
@@ -44,9 +50,10 @@ static inline void ASSERT_DOUBLE_EQ_LOOP(const std::vector<double> &refV,
     }
 }
 
-template <typename T>
-static inline void ASSERT_EQ_LOOP(const std::vector<T> &refV,
-                                  const std::vector<T> &realV,
+template <typename T, typename A1 = std::allocator<T>,
+          typename A2 = std::allocator<T>>
+static inline void ASSERT_EQ_LOOP(const std::vector<T, A1> &refV,
+                                  const std::vector<T, A2> &realV,
                                   const std::string &varName)
 {
     ASSERT_EQ(refV.size(), realV.size());
@@ -221,6 +221,195 @@ TEST_F(testTracker, rf_voltage_calculation3)
 }
 
 
+TEST_F(testTracker, kick_drift_histogram1)
+{
+    auto Slice = Context::Slice;
+    auto Beam = Context::Beam;
+    auto RfP = Context::RfP;
+
+    Beams fusedBeam(*Beam);
+    Slices fusedSlice(RfP, &fusedBeam, N_slices, 0,
+                      Slice->cut_left, Slice->cut_right);
+
+    auto long_tracker = new RingAndRfSection(RfP, Beam);
+    auto fused_tracker = new RingAndRfSection(RfP, &fusedBeam,
+            RingAndRfSection::simple, NULL, NULL, false, 0.0, false,
+            &fusedSlice, NULL, true);
+
+    for (int i = 0; i < 10; i++) {
+        long_tracker->track();
+        Slice->track();
+    }
+
+    RfP->counter = 0;
+    fusedBeam.stream_statistics = true;
+    for (int i = 0; i < 10; i++)
+        fused_tracker->track();
+
+    ASSERT_EQ_LOOP(Beam->dE, fusedBeam.dE, "dE");
+    ASSERT_EQ_LOOP(Beam->dt, fusedBeam.dt, "dt");
+    ASSERT_EQ_LOOP(Slice->n_macroparticles, fusedSlice.n_macroparticles,
+                   "n_macroparticles");
+
+    // The statistics streamed with the last fused pass
+    Beam->statistics();
+    ASSERT_NEAR(Beam->mean_dt, fusedBeam.mean_dt, 1e-12 * Beam->mean_dt);
+    ASSERT_NEAR(Beam->sigma_dt, fusedBeam.sigma_dt, 1e-12 * Beam->sigma_dt);
+    ASSERT_NEAR(Beam->sigma_dE, fusedBeam.sigma_dE, 1e-12 * Beam->sigma_dE);
+    ASSERT_EQ(Beam->n_macroparticles_lost, fusedBeam.n_macroparticles_lost);
+
+    delete long_tracker;
+    delete fused_tracker;
+}
+
+TEST_F(testTracker, kick_drift_histogram2)
+{
+    auto Slice = Context::Slice;
+    auto Beam = Context::Beam;
+    auto RfP = Context::RfP;
+
+    // The fused pass with the adaptive frame and the bunch pattern
+    Beam->stream_statistics = true;
+    Beam->statistics();
+    Beams fusedBeam(*Beam);
+    Slices fusedSlice(RfP, &fusedBeam, N_slices, 0,
+                      Slice->cut_left, Slice->cut_right);
+    for (auto slices : {Slice, &fusedSlice}) {
+        slices->set_adaptive_frame(4, 8, 64);
+        slices->set_bunch_pattern({0, 1}, 16);
+    }
+
+    auto long_tracker = new RingAndRfSection(RfP, Beam);
+    auto fused_tracker = new RingAndRfSection(RfP, &fusedBeam,
+            RingAndRfSection::simple, NULL, NULL, false, 0.0, false,
+            &fusedSlice, NULL, true);
+
+    for (int i = 0; i < 10; i++) {
+        long_tracker->track();
+        Slice->track();
+    }
+
+    RfP->counter = 0;
+    for (int i = 0; i < 10; i++)
+        fused_tracker->track();
+
+    ASSERT_EQ_LOOP(Beam->dt, fusedBeam.dt, "dt");
+    ASSERT_EQ(Slice->n_slices, fusedSlice.n_slices);
+    ASSERT_EQ_LOOP(Slice->edges, fusedSlice.edges, "edges");
+    ASSERT_EQ_LOOP(Slice->n_macroparticles, fusedSlice.n_macroparticles,
+                   "n_macroparticles");
+    ASSERT_EQ_LOOP(Slice->bunch_profiles, fusedSlice.bunch_profiles,
+                   "bunch_profiles");
+
+    delete long_tracker;
+    delete fused_tracker;
+}
+
+TEST_F(testTracker, single_precision_track1)
+{
+    auto Slice = Context::Slice;
+    auto Beam = Context::Beam;
+    auto RfP = Context::RfP;
+
+    longitudinal_bigaussian(Context::GP, RfP, Beam, tau_0 / 4, 0, 1, false);
+    Beams floatBeam(*Beam);
+    Slices floatSlice(RfP, &floatBeam, N_slices, 0,
+                      Slice->cut_left, Slice->cut_right);
+
+    auto long_tracker = new RingAndRfSection(RfP, Beam);
+    auto float_tracker = new RingAndRfSection(RfP, &floatBeam);
+    float_tracker->set_precision(ParticleStorage::single_precision);
+    ASSERT_DOUBLE_EQ(float_tracker->synchronous_dt(0), floatBeam.dt_reference);
+
+    for (int i = 0; i < 10; i++) {
+        long_tracker->track();
+        Slice->track();
+    }
+
+    RfP->counter = 0;
+    for (int i = 0; i < 10; i++) {
+        float_tracker->track();
+        floatSlice.track();
+    }
+
+    floatBeam.set_precision(ParticleStorage::double_precision);
+    ASSERT_NEAR_LOOP(Beam->dE, floatBeam.dE, "dE", 1e-5);
+    ASSERT_NEAR_LOOP(Beam->dt, floatBeam.dt, "dt", 1e-6);
+    ASSERT_NEAR_LOOP(Slice->n_macroparticles, floatSlice.n_macroparticles,
+                     "n_macroparticles", 1e-2);
+
+    delete long_tracker;
+    delete float_tracker;
+}
+
+TEST_F(testTracker, horizontal_cut1)
+{
+    auto Beam = Context::Beam;
+
+    longitudinal_bigaussian(Context::GP, Context::RfP, Beam, tau_0 / 4, 0, 1,
+                            false);
+    Beam->statistics();
+    const double dE_max = Beam->sigma_dE;
+
+    auto long_tracker = new RingAndRfSection(Context::RfP, Beam,
+            RingAndRfSection::simple, NULL, NULL, false, dE_max);
+    auto ref_tracker = new RingAndRfSection();
+
+    Beams refBeam(*Beam);
+    long_tracker->track();
+    Context::RfP->counter = 0;
+    ref_tracker->kick(refBeam.dt, refBeam.dE, 0);
+    ref_tracker->drift(refBeam.dt, refBeam.dE, 1);
+
+    f_vector_t dt, dE;
+    for (int i = 0; i < refBeam.n_macroparticles; i++) {
+        if (refBeam.dE[i] > -dE_max) {
+            dt.push_back(refBeam.dt[i]);
+            dE.push_back(refBeam.dE[i]);
+        }
+    }
+
+    ASSERT_GT(dE.size(), 0u);
+    ASSERT_LT(dE.size(), (uint) N_p);
+    ASSERT_EQ((int) dE.size(), Beam->n_macroparticles);
+    ASSERT_EQ(dE.size(), Beam->id.size());
+    ASSERT_EQ_LOOP(dt, Beam->dt, "dt");
+    ASSERT_EQ_LOOP(dE, Beam->dE, "dE");
+
+    delete long_tracker;
+    delete ref_tracker;
+}
+
+TEST_F(testTracker, validate_precision1)
+{
+    auto Beam = Context::Beam;
+
+    longitudinal_bigaussian(Context::GP, Context::RfP, Beam, tau_0 / 4, 0, 1,
+                            false);
+    const f_vector_t dt(Beam->dt.begin(), Beam->dt.end());
+
+    auto long_tracker = new RingAndRfSection();
+    auto report = long_tracker->validate_precision(100);
+
+    // the beam and the turn counter are left as they were
+    ASSERT_EQ(0, Context::RfP->counter);
+    ASSERT_EQ(ParticleStorage::double_precision, Beam->precision);
+    ASSERT_EQ_LOOP(dt, Beam->dt, "dt");
+
+    Beam->statistics();
+    ASSERT_EQ(100, report.n_turns);
+    ASSERT_GT(report.max_dt_error, 0.);
+    ASSERT_LT(report.max_dt_error, 1e-4 * Beam->sigma_dt);
+    ASSERT_LT(report.max_dE_error, 1e-4 * Beam->sigma_dE);
+    ASSERT_LE(report.rms_dt_error, report.max_dt_error);
+    ASSERT_LE(report.rms_dE_error, report.max_dE_error);
+    ASSERT_LT(std::fabs(report.mean_dt_error), 1e-5 * Beam->sigma_dt);
+    ASSERT_LT(std::fabs(report.sigma_dE_error), 1e-5 * Beam->sigma_dE);
+
+    delete long_tracker;
+}
+
+
 class testTracker2 : public ::testing::Test {
 
 protected:
@@ -446,6 +635,217 @@ TEST_F(testTracker2, full_solver4)
 
 
 
+TEST_F(testTracker2, full_solver_fast_reciprocal1)
+{
+    f_vector_2d_t momentumVec(n_sections);
+    for (auto &v : momentumVec)
+        v = mymath::linspace(p_i, p_f, N_t + 1);
+
+    f_vector_2d_t alphaVec({{alpha, alpha / gamma_t, 2 * alpha / gamma_t}});
+
+    f_vector_t CVec(n_sections, C);
+
+    f_vector_2d_t hVec(n_sections, f_vector_t(N_t + 1, h));
+
+    f_vector_2d_t voltageVec(n_sections, f_vector_t(N_t + 1, V));
+
+    f_vector_2d_t dphiVec(n_sections, f_vector_t(N_t + 1, dphi));
+
+    auto GP = GeneralParameters(N_t, CVec, alphaVec,
+                                momentumVec,
+                                GeneralParameters::particle_t::proton);
+
+    auto Beam = Beams(&GP, N_p, N_b);
+
+    auto RfP = RfParameters(&GP, n_sections, hVec,
+                            voltageVec, dphiVec);
+
+    longitudinal_bigaussian(&GP, &RfP, &Beam, tau_0 / 4, 0, 1, false);
+    auto fastBeam = Beam;
+    auto splitBeam = Beam;
+
+    auto long_tracker = RingAndRfSection(&RfP, &Beam, RingAndRfSection::full);
+    auto fast_tracker = RingAndRfSection(&RfP, &fastBeam,
+                                         RingAndRfSection::full, NULL, NULL,
+                                         false, 0.0, false, NULL, NULL,
+                                         false, true);
+
+    for (int i = 0; i < 10; i++)
+        long_tracker.track();
+
+    // track() runs the fused kick and drift, per particle the same as
+    // kick() followed by drift()
+    for (int i = 0; i < 10; i++) {
+        long_tracker.kick(splitBeam.dt, splitBeam.dE, i);
+        long_tracker.drift(splitBeam.dt, splitBeam.dE, i + 1);
+    }
+    ASSERT_EQ_LOOP(Beam.dE, splitBeam.dE, "dE");
+    ASSERT_EQ_LOOP(Beam.dt, splitBeam.dt, "dt");
+
+    // Both drifts of the tracked energies against T * x / (1 - x) in long
+    // double. Drifting dt = 0 gives the increment itself. The reference
+    // drift T * (1 / (1 - x) - 1) loses digits in the subtraction, its
+    // error is bounded by a few ulp of T. The error of the fast variant is
+    // relative, the refined reciprocal has at least 46 correct bits.
+    const double eps = std::numeric_limits<double>::epsilon();
+    for (int i = 1; i <= 10; i++) {
+        auto longDt = Beam.dt, fastDt = Beam.dt;
+        std::fill(longDt.begin(), longDt.end(), 0.);
+        std::fill(fastDt.begin(), fastDt.end(), 0.);
+        long_tracker.drift(longDt, Beam.dE, i);
+        fast_tracker.drift(fastDt, Beam.dE, i);
+
+        const long double T = (long double) RfP.t_rev[i] * RfP.length_ratio;
+        const long double coeff = 1.L / ((long double) RfP.beta[i]
+                                         * RfP.beta[i] * RfP.energy[i]);
+        for (int j = 0; j < N_p; j++) {
+            const long double dE = Beam.dE[j] * coeff;
+            const long double x = dE * (RfP.eta_0[i]
+                                        + dE * (RfP.eta_1[i]
+                                                + dE * RfP.eta_2[i]));
+            const double exact = T * x / (1.L - x);
+            ASSERT_NEAR(exact, longDt[j], 4 * eps * (T + std::fabs(exact)))
+                    << "reference drift, turn " << i << ", particle " << j;
+            ASSERT_NEAR(exact, fastDt[j], 128 * eps * std::fabs(exact))
+                    << "fast drift, turn " << i << ", particle " << j;
+        }
+    }
+}
+
+TEST_F(testTracker2, tabulated_kick1)
+{
+    const int n_rf = 3;
+    const double max_error = 1.;
+    f_vector_2d_t momentumVec(n_sections);
+    for (auto &v : momentumVec)
+        v = mymath::linspace(p_i, p_f, N_t + 1);
+
+    f_vector_2d_t alphaVec(n_sections, f_vector_t(1, alpha));
+
+    f_vector_t CVec(n_sections, C);
+
+    f_vector_2d_t hVec(n_rf), voltageVec(n_rf);
+    for (int i = 0; i < n_rf; i++) {
+        hVec[i] = f_vector_t(N_t + 1, (i + 1) * h);
+        voltageVec[i] = f_vector_t(N_t + 1, V / (i + 1));
+    }
+
+    f_vector_2d_t dphiVec(n_rf, f_vector_t(N_t + 1, dphi));
+
+    auto GP = GeneralParameters(N_t, CVec, alphaVec, momentumVec,
+                                GeneralParameters::particle_t::proton);
+
+    auto Beam = Beams(&GP, N_p, N_b);
+
+    auto RfP = RfParameters(&GP, n_rf, hVec, voltageVec, dphiVec);
+
+    longitudinal_bigaussian(&GP, &RfP, &Beam, tau_0 / 4, 0, 1, false);
+    auto tableBeam = Beam;
+
+    auto long_tracker = RingAndRfSection(&RfP, &Beam);
+    auto table_tracker = RingAndRfSection(&RfP, &tableBeam);
+    table_tracker.set_tabulated_kick(max_error);
+
+    long_tracker.kick(Beam.dt, Beam.dE, 0);
+    table_tracker.kick(tableBeam.dt, tableBeam.dE, 0);
+    const int points = table_tracker.tabulated_kick_points();
+    ASSERT_GT(points, 0);
+    ASSERT_NEAR_LOOP(Beam.dE, tableBeam.dE, "dE", max_error);
+
+    // Unchanged RF parameters, the same table
+    long_tracker.kick(Beam.dt, Beam.dE, 1);
+    table_tracker.kick(tableBeam.dt, tableBeam.dE, 1);
+    ASSERT_EQ(points, table_tracker.tabulated_kick_points());
+    ASSERT_NEAR_LOOP(Beam.dE, tableBeam.dE, "dE", 2 * max_error);
+
+    // A harmonic that is not a multiple of the lowest one, no table
+    for (int j = 0; j < N_t + 1; j++) hVec[1][j] = 1.5 * h;
+    auto RfP2 = RfParameters(&GP, n_rf, hVec, voltageVec, dphiVec);
+    auto direct_tracker = RingAndRfSection(&RfP2, &Beam);
+    auto fallback_tracker = RingAndRfSection(&RfP2, &tableBeam);
+    fallback_tracker.set_tabulated_kick(max_error);
+    tableBeam.dE = Beam.dE;
+
+    direct_tracker.kick(Beam.dt, Beam.dE, 0);
+    fallback_tracker.kick(tableBeam.dt, tableBeam.dE, 0);
+    ASSERT_EQ(0, fallback_tracker.tabulated_kick_points());
+    ASSERT_EQ_LOOP(Beam.dE, tableBeam.dE, "dE");
+}
+
+TEST_F(testTracker2, full_ring_blocks1)
+{
+    const int n_sections = 3;
+    const int n_particles = 10000;
+    f_vector_2d_t momentumVec(n_sections);
+    for (auto &v : momentumVec)
+        v = mymath::linspace(p_i, p_f, N_t + 1);
+
+    f_vector_2d_t alphaVec(n_sections, f_vector_t(1, alpha));
+
+    f_vector_t CVec(n_sections, C / n_sections);
+
+    f_vector_2d_t hVec(1, f_vector_t(N_t + 1, h));
+
+    f_vector_2d_t voltageVec(1, f_vector_t(N_t + 1, V / n_sections));
+
+    f_vector_2d_t dphiVec(1, f_vector_t(N_t + 1, dphi));
+
+    auto GP = GeneralParameters(N_t, CVec, alphaVec, momentumVec,
+                                GeneralParameters::particle_t::proton, 0, 0,
+                                GeneralParameters::particle_t::none, 0, 0,
+                                n_sections);
+
+    auto Beam = Beams(&GP, n_particles, N_b);
+
+    auto RfP = RfParameters(&GP, 1, hVec, voltageVec, dphiVec);
+
+    longitudinal_bigaussian(&GP, &RfP, &Beam, tau_0 / 4, 0, 1, false);
+    auto refBeam = Beam;
+
+    // The first two sections only kick and drift and are tracked block by
+    // block, the last one cuts the beam and is tracked on its own
+    vector<RfParameters *> rfps, ref_rfps;
+    vector<RingAndRfSection *> rings, ref_rings;
+    for (int i = 0; i < n_sections; i++) {
+        const double dE_max = (i == n_sections - 1) ? 1e9 : 0.;
+        rfps.push_back(new RfParameters(&GP, 1, hVec, voltageVec, dphiVec,
+                                        f_vector_2d_t(), f_vector_2d_t(),
+                                        i + 1));
+        ref_rfps.push_back(new RfParameters(&GP, 1, hVec, voltageVec, dphiVec,
+                                            f_vector_2d_t(), f_vector_2d_t(),
+                                            i + 1));
+        rings.push_back(new RingAndRfSection(rfps[i], &Beam,
+                                             RingAndRfSection::simple, NULL,
+                                             NULL, false, dE_max));
+        ref_rings.push_back(new RingAndRfSection(ref_rfps[i], &refBeam,
+                            RingAndRfSection::simple, NULL,
+                            NULL, false, dE_max));
+    }
+    rings[1]->set_tabulated_kick(1.);
+    ref_rings[1]->set_tabulated_kick(1.);
+
+    auto full_ring = FullRingAndRf(rings);
+    for (int turn = 0; turn < 10; turn++) {
+        full_ring.track();
+        for (auto &ring : ref_rings)
+            ring->track();
+    }
+
+    for (int i = 0; i < n_sections; i++)
+        ASSERT_EQ(ref_rfps[i]->counter, rfps[i]->counter);
+    // The same operations per particle, up to the reassociation the
+    // compiler may apply in either loop
+    ASSERT_NEAR_LOOP(refBeam.dE, Beam.dE, "dE", 1e-12);
+    ASSERT_NEAR_LOOP(refBeam.dt, Beam.dt, "dt", 1e-12);
+
+    for (int i = 0; i < n_sections; i++) {
+        delete rings[i];
+        delete ref_rings[i];
+        delete rfps[i];
+        delete ref_rfps[i];
+    }
+}
+
 class testTrackerMultiRf : public ::testing::Test {
 
 protected:
@@ -660,6 +1060,35 @@ TEST_F(testTrackerPeriodicity, set_periodicity1)
     delete long_tracker;
 }
 
+TEST_F(testTrackerPeriodicity, set_periodicity2)
+{
+    auto Beam = Context::Beam;
+    longitudinal_bigaussian(Context::GP, Context::RfP, Beam, tau_0 / 4, 0, 1,
+                            false);
+
+    auto long_tracker = new RingAndRfSection(Context::RfP, Beam,
+            RingAndRfSection::simple, NULL, NULL, true, 0.0);
+
+    auto mean = mymath::mean(Beam->dt.data(), Beam->dt.size());
+    Context::GP->t_rev[Context::RfP->counter + 1] = mean;
+
+    int_vector_t right, inside;
+    for (int i = 0; i < N_p; ++i) {
+        if (Beam->dt[i] > mean) right.push_back(i);
+        else if (Beam->dt[i] < mean) inside.push_back(i);
+    }
+
+    // the per thread blocks must be stitched back in order
+    for (int threads = 1; threads <= 4; ++threads) {
+        omp_set_num_threads(threads);
+        long_tracker->set_periodicity();
+        ASSERT_EQ(right, long_tracker->indices_right_outside);
+        ASSERT_EQ(inside, long_tracker->indices_inside_frame);
+        ASSERT_TRUE(long_tracker->indices_left_outside.empty());
+    }
+
+    delete long_tracker;
+}
 
 TEST_F(testTrackerPeriodicity, track1)
 {